@@ -1,344 +1,311 @@
 #include <iostream>
-#include <vector>
-#include <future>
-#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 #include <chrono>
 #include <SDL2/SDL.h>
+#include "src/renderer.h"
+#include "src/benchmark.h"
+#include "src/rayPacket.h"
+#include "src/sceneFile.h"
+#include "src/mesh.h"
+#include "src/interactive.h"
+#include "src/framePipeline.h"
+#include "src/profiler.h"
+#include "src/distributed.h"
+#include "src/sequence.h"
 
 using std::cout, std::endl, std::cin;
 
-thread_local int lastShadowed = -1;
-
-enum lightType {
-    AMBIENT, POINT, DIRECTIONAL
-};
-
-struct Vec2 {
-    float x, y;
-};
-
-struct Vec3 {
-    float x, y, z;
-
-    Vec3 operator+(const Vec3& o) const { return {x + o.x, y + o.y, z + o.z}; }
-    Vec3 operator-(const Vec3& o) const { return {x - o.x, y - o.y, z - o.z}; }
-    Vec3 operator*(float s) const { return {x * s, y * s, z * s}; }
-    float dot(const Vec3& o) const { return x * o.x + y * o.y + z * o.z; }
-    Vec3 cross(const Vec3& o) const {
-        return {
-            y * o.z - z * o.y,
-            z * o.x - x * o.z,
-            x * o.y - y * o.x
-        };
-    }
-    Vec3 normalized() const {
-        float m = std::sqrt(x * x + y * y + z * z);
-        return m > 0.0f ? *this * (1.0f / m) : *this;
-    }
-    float mag() const { return sqrt(x * x + y * y + z * z); }
-};
-
-struct Sphere {
-    Vec3 origin;
-    Vec3 color;
-    float radius;
-    float f;
-    float reflectiveness;
-    int specular;
-    float rSquared;
-};
-
-struct Light {
-    lightType type;
-    float intensity;
-    Vec3 pos;
-};
-
-Sphere spheres[4] = {
-    {{0, -1, 3}, {255, 0, 0}, 1, 0, 0.2f, 500, 1},         // red, shiny, bit reflective
-    {{2, 0, 4}, {0, 0, 255}, 1, 0, 0.3f, 500, 1},          // blue, shiny, bit more reflective
-    {{-2, 0, 4}, {0, 255, 0}, 1, 0, 0.4f, 10, 1},          // green, somewhat shiny, more reflective
-    {{0, -5001, 0}, {255, 255, 0}, 5000, 0, 0.5f, 1000, static_cast<float>(pow(5000, 2))} // yellow, very Shiny, half reflective
-};
-
-Sphere calculateBoundingSphere(Sphere *spheres, int numSpheres) {
-    Vec3 avg = {0, 0, 0};
-    for (int i = 0; i < numSpheres; i++) {
-        avg.x += spheres[i].origin.x;
-        avg.y += spheres[i].origin.y;
-        avg.z += spheres[i].origin.z;
-    }
-
-    avg.x /= numSpheres;
-    avg.y /= numSpheres;
-    avg.z /= numSpheres;
-
-    float radius = 0;
-    for (int i = 0; i < numSpheres; i++) {
-        Vec3 avgToSphere = avg - spheres[i].origin;
-        Vec3 avgToSphereEdge = avgToSphere + avgToSphere.normalized() * spheres[i].radius;
-        float mag = avgToSphereEdge.mag();
-        if (mag > radius) {
-            radius = mag;
-        }
-    }
-    return Sphere {avg, {0,0,0}, radius, 0, 0, 0, static_cast<float>(pow(radius, 2))};
-}
-
-Sphere smallSphereBoundingSphere;
-
-Light lights[3] = {{AMBIENT, 0.2}, {POINT, 0.6, {2, 1, 0}}, {DIRECTIONAL, 0.2, {1, 4, 4}}};
-
 float rotationSpeed = 0.05f;
 float moveSpeed = 0.5f;
 
-int RES_X = 500;
-int RES_Y = 500;
-
-#define BACKGROUND_COLOR {0, 0, 0}
-
-int INF = 16777215;
-float TMIN = 0.05f;
-
-int reflectRecursion = 3;
-
-float distance = 1.0f;
-
-int FOV = 53;
-
-float aspectRatio = (float)RES_X / RES_Y;
-float fovScale = tanf(FOV * 0.5f * M_PI / 180.0f); // if FOV in degrees
-float aspectTimesFovScale = aspectRatio * fovScale;
+// trace events kept for --trace, about 40 MB
+const size_t TRACE_EVENT_BUDGET = 1000000;
 
 bool wKeyDown, aKeyDown, sKeyDown, dKeyDown, qKeyDown, eKeyDown, spaceKeyDown, shiftKeyDown, backspaceKeyDown;
 
-Vec3 cameraPos = {0, 0, 0};
-Vec3 cameraForward = {0, 0, 1};
-Vec3 cameraUp = {0, 1, 0};
-Vec3 cameraRight = {1, 0, 0};
-
-Vec3 rotateAroundAxis(const Vec3& vec, const Vec3& axis, float angle) {
-    Vec3 k = axis.normalized();
-    float cosTheta = std::cos(angle);
-    float sinTheta = std::sin(angle);
-    Vec3 vCrossK = k.cross(vec);
-    float kDotV = k.dot(vec);
-
-    return {
-        vec.x * cosTheta + vCrossK.x * sinTheta + k.x * kDotV * (1 - cosTheta),
-        vec.y * cosTheta + vCrossK.y * sinTheta + k.y * kDotV * (1 - cosTheta),
-        vec.z * cosTheta + vCrossK.z * sinTheta + k.z * kDotV * (1 - cosTheta)
-    };
-}
-
-void setPixel(SDL_Surface *surface, int x, int y, Uint32 color) {
-    Uint8 *p = (Uint8*)surface->pixels + y * surface->pitch + x * 4; // 4 being bytes per pixel
-    *(Uint32*)p = color;
-}
-
-Vec3 canvasToViewport(int x, int y) {
-    float u = ((x + 0.5f) / RES_X * 2 - 1) * aspectTimesFovScale;
-    float v = (1 - (y + 0.5f) / RES_Y * 2) * fovScale;
-
-    return (cameraForward + cameraRight * u + cameraUp * v).normalized();
+void pollKeysPressed() {
+    const Uint8 *state = SDL_GetKeyboardState(NULL);
+    wKeyDown = state[SDL_SCANCODE_W];
+    aKeyDown = state[SDL_SCANCODE_A];
+    sKeyDown = state[SDL_SCANCODE_S];
+    dKeyDown = state[SDL_SCANCODE_D];
+    qKeyDown = state[SDL_SCANCODE_Q];
+    eKeyDown = state[SDL_SCANCODE_E];
+    spaceKeyDown = state[SDL_SCANCODE_SPACE];
+    shiftKeyDown = state[SDL_SCANCODE_LSHIFT];
+    backspaceKeyDown = state[SDL_SCANCODE_BACKSPACE];
 }
 
-Vec3 reflectRay(Vec3 ray, Vec3 normal) {
-    return normal * normal.dot(ray) * 2 - ray;
+void printUsage() {
+    cout << "usage: Renderer [--headless | --bench] [options]\n"
+            "  --headless          render one frame offscreen and write it as a PPM\n"
+            "  --bench             render the benchmark pose set offscreen and report timings\n"
+            "  --res WxH           resolution (default 500x500)\n"
+            "  --depth N           reflectRecursion (default 3)\n"
+            "  --tile N            TILE size in pixels (default 32)\n"
+            "  --threads N         render pool workers, 0 = every hardware thread (default 0)\n"
+            "  --pin               pin render pool workers to cores\n"
+            "  --wavefront         trace breadth-first in stage queues instead of recursively\n"
+            "  --aa N              edge anti-aliasing: N extra samples on pixels at edges (default 0, off)\n"
+            "  --aa-budget F       most of the frame's pixels that get extra samples (default 0.25)\n"
+            "  --aa-luma F         luminance step between neighbours that counts as an edge, 0-1 (default 0.03)\n"
+            "  --aa-normal DEG     angle between neighbouring normals that counts as an edge (default 20)\n"
+            "  --adaptive-tiles    size and order tiles by the previous frame's tile costs instead of a fixed TILE grid\n"
+            "  --simd LEVEL        packet kernel: scalar, sse or avx2 (default: best supported)\n"
+            "  --scene PATH        load a text or binary (.rscn) scene instead of the built-in one\n"
+            "  --save-scene PATH   write the scene (.rscn = binary, else text); exits unless rendering headless\n"
+            "  --convert IN OUT    convert a scene between the text and binary formats and exit\n"
+            "  --spheres N         add N random small spheres to the scene\n"
+            "  --lights N          add N random point lights with a range to the scene\n"
+            "  --light-cutoff F    skip lights adding less than F at a point, and their shadow rays (default 0.002)\n"
+            "  --obj PATH          add a triangle mesh from an OBJ file (repeatable)\n"
+            "  --target-ms N       interactive frame time to hold while moving, by lowering resolution (default 16)\n"
+            "  --samples N         progressive samples per pixel once the camera stops (default 64)\n"
+            "  --buffers N         frames in flight in the window, 2 or 3 (default 2)\n"
+            "  --fps N             window frame rate to pace to (default: display refresh rate), or the sequence's (default 30)\n"
+            "  --frames N          timed frames per pose (default 20), or frames in the sequence (default 100)\n"
+            "  --warmup N          untimed frames per pose (default 2)\n"
+            "  --coordinator ADDR  render one frame across worker processes, ADDR = unix:PATH or HOST:PORT\n"
+            "  --local-workers N   worker processes the coordinator starts on this machine (default 0)\n"
+            "  --worker ADDR       render tiles for the coordinator at ADDR\n"
+            "  --sequence PATH     render frames along a camera keyframe path and stream them out\n"
+            "  --out PATH          sequence output file, - for stdout (default -)\n"
+            "  --format FORMAT     sequence output: y4m or rgb (default y4m)\n"
+            "  --ppm PATH          output image (headless) or prefix for per-pose dumps (bench)\n"
+            "  --compare PATH      headless: diff the frame against a reference PPM, exit 1 unless identical\n"
+            "  --trace PATH        write a Chrome trace of tiles and frame stages on exit (RENDER_PROFILE builds)" << endl;
 }
 
-Vec2 intersectRaySphere(Vec3 origin, Vec3 dir, float dotDir, Sphere sphere) {
-    float r = sphere.radius;
-    Vec3 co = origin - sphere.origin;
-
-    float a = dotDir;
-    float b = 2 * co.dot(dir);
-    float c = co.dot(co) - sphere.rSquared;
-
-    float discriminant = b*b - 4*a*c;
-    if (discriminant < 0) {
-        return Vec2 {(float)INF, (float)INF};
+// writes the --trace file, if one was asked for; call once no frame is in flight
+bool finishTrace([[maybe_unused]] const std::string &path) {
+#ifdef RENDER_PROFILE
+    if (!path.empty()) {
+        return writeChromeTrace(path);
     }
-
-    float t1 = (-b + sqrt(discriminant)) / (2*a);
-    float t2 = (-b - sqrt(discriminant)) / (2*a);
-
-    return Vec2 {t1, t2};
+#endif
+    return true;
 }
 
-Sphere *closestIntersection(Vec3 origin, Vec3 dir, float tMax) {
-    float closestT = tMax;
-    Sphere *closestSphere = nullptr;
-    float dotDir = dir.dot(dir);
-
-    // custom bounding logic
-
-    Vec2 t = intersectRaySphere(origin, dir, dotDir, smallSphereBoundingSphere);
-    if (t.x != (float)INF || t.y != (float)INF) {
-        for (int i = 0; i < 3; i++) {
-            Vec2 t = intersectRaySphere(origin, dir, dotDir, spheres[i]);
-            if (t.x > TMIN && t.x < tMax && t.x < closestT) {
-                closestT = t.x;
-                closestSphere = &spheres[i];
+int main(int argc, char **argv) {
+    bool headless = false;
+    bool bench = false;
+    BenchConfig config;
+    std::string scenePath;
+    std::string saveScenePath;
+    std::vector<std::string> objPaths;
+    InteractiveConfig interactive;
+    int buffers = 2;
+    int refreshRate = 0;
+    std::string tracePath;
+    std::string coordinatorAddress;
+    std::string workerAddress;
+    int localWorkers = 0;
+    SequenceConfig sequence;
+    bool framesGiven = false;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            bench = true;
+        } else if (strcmp(argv[i], "--res") == 0 && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &config.resX, &config.resY) != 2) {
+                printUsage();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--depth") == 0 && hasValue) {
+            config.depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tile") == 0 && hasValue) {
+            config.tile = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && hasValue) {
+            config.threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pin") == 0) {
+            config.pin = true;
+        } else if (strcmp(argv[i], "--simd") == 0 && hasValue) {
+            i++;
+            if (strcmp(argv[i], "scalar") == 0) {
+                config.simd = SIMD_SCALAR;
+            } else if (strcmp(argv[i], "sse") == 0) {
+                config.simd = SIMD_SSE;
+            } else if (strcmp(argv[i], "avx2") == 0) {
+                config.simd = SIMD_AVX2;
+            } else {
+                printUsage();
+                return 1;
             }
-            if (t.y > TMIN && t.y < tMax && t.y < closestT) {
-                closestT = t.y;
-                closestSphere = &spheres[i];
+        } else if (strcmp(argv[i], "--scene") == 0 && hasValue) {
+            scenePath = argv[++i];
+        } else if (strcmp(argv[i], "--save-scene") == 0 && hasValue) {
+            saveScenePath = argv[++i];
+        } else if (strcmp(argv[i], "--convert") == 0 && i + 2 < argc) {
+            bool ok = convertScene(argv[i + 1], argv[i + 2]);
+            unloadScene();
+            return ok ? 0 : 1;
+        } else if (strcmp(argv[i], "--spheres") == 0 && hasValue) {
+            config.randomSpheres = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--lights") == 0 && hasValue) {
+            config.randomLights = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--light-cutoff") == 0 && hasValue) {
+            config.lightCutoff = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--obj") == 0 && hasValue) {
+            objPaths.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--wavefront") == 0) {
+            config.wavefront = true;
+        } else if (strcmp(argv[i], "--aa") == 0 && hasValue) {
+            config.aa.samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--aa-budget") == 0 && hasValue) {
+            config.aa.budget = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--aa-luma") == 0 && hasValue) {
+            config.aa.lumaThreshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--aa-normal") == 0 && hasValue) {
+            config.aa.normalThreshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--adaptive-tiles") == 0) {
+            config.adaptiveTiles = true;
+        } else if (strcmp(argv[i], "--target-ms") == 0 && hasValue) {
+            interactive.targetFrameMs = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--samples") == 0 && hasValue) {
+            interactive.maxSamples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--buffers") == 0 && hasValue) {
+            buffers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fps") == 0 && hasValue) {
+            refreshRate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--frames") == 0 && hasValue) {
+            config.frames = atoi(argv[++i]);
+            framesGiven = true;
+        } else if (strcmp(argv[i], "--sequence") == 0 && hasValue) {
+            sequence.path = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && hasValue) {
+            sequence.out = argv[++i];
+        } else if (strcmp(argv[i], "--format") == 0 && hasValue) {
+            i++;
+            if (strcmp(argv[i], "y4m") == 0) {
+                sequence.format = FRAME_Y4M;
+            } else if (strcmp(argv[i], "rgb") == 0) {
+                sequence.format = FRAME_RGB;
+            } else {
+                printUsage();
+                return 1;
             }
+        } else if (strcmp(argv[i], "--warmup") == 0 && hasValue) {
+            config.warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ppm") == 0 && hasValue) {
+            config.ppm = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && hasValue) {
+            config.compare = argv[++i];
+        } else if (strcmp(argv[i], "--coordinator") == 0 && hasValue) {
+            coordinatorAddress = argv[++i];
+        } else if (strcmp(argv[i], "--local-workers") == 0 && hasValue) {
+            localWorkers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--worker") == 0 && hasValue) {
+            workerAddress = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && hasValue) {
+            tracePath = argv[++i];
+        } else {
+            printUsage();
+            return 1;
         }
-    } 
-    t = intersectRaySphere(origin, dir, dotDir, spheres[3]);
-    if (t.x > TMIN && t.x < tMax && t.x < closestT) {
-        closestT = t.x;
-        closestSphere = &spheres[3];
-    }
-    if (t.y > TMIN && t.y < tMax && t.y < closestT) {
-        closestT = t.y;
-        closestSphere = &spheres[3];
     }
 
-
-    if (closestSphere != nullptr) closestSphere->f = closestT;
-    return closestSphere;
-}
-
-bool isShadowed(Vec3 origin, Vec3 dir, float tMax, int lastShadowedSphere) {
-    float dotDir = dir.dot(dir);
-
-    if (lastShadowedSphere != -1) {
-        Vec2 t = intersectRaySphere(origin, dir, dotDir, spheres[lastShadowedSphere]);
-        if (t.x != (float)INF || t.y != (float)INF) {
-            return false;
-        }
+    if (config.resX <= 0 || config.resY <= 0 || config.tile <= 0 || config.frames <= 0 ||
+        interactive.targetFrameMs <= 0 || interactive.maxSamples <= 0 || buffers < 2 || buffers > 3 || refreshRate < 0 ||
+        localWorkers < 0 || config.aa.samples < 0 || config.aa.budget < 0 || config.aa.budget > 1 ||
+        config.lightCutoff < 0) {
+        printUsage();
+        return 1;
     }
 
-    for (int i = 0; i < sizeof(spheres) / sizeof(Sphere); i++) {
-        Vec2 t = intersectRaySphere(origin, dir, dotDir, spheres[i]);
-        if (t.x != (float)INF || t.y != (float)INF) {
-            lastShadowed = i;
-            return false;
+    if (!sequence.path.empty()) {
+        sequence.frames = framesGiven ? config.frames : sequence.frames;
+        sequence.fps = refreshRate > 0 ? refreshRate : sequence.fps;
+        if (sequence.out == "-") {
+            // stdout carries the frames, so everything else goes to stderr
+            cout.rdbuf(std::cerr.rdbuf());
         }
     }
-    lastShadowed = -1;
-    return true;
-}
-
-float computeLighting(Vec3 point, Vec3 normal, Vec3 pointToCamera, int specular) {
-    float intensity = 0.0f;
-    for (int i = 0; i < sizeof(lights) / sizeof(Light); i++) {
-        Light &light = lights[i];
-        if (light.type == AMBIENT) {
-            intensity += light.intensity;
-        } else {
-            Vec3 L;
-            float tMax;
-            if (light.type == POINT) {
-                L = light.pos - point;
-                tMax = 1;
-            } else { // type is directional
-                L = light.pos;
-                tMax = (float)INF;
-            }
 
-            // Shadow check
-            if (isShadowed(point, L, tMax, lastShadowed)) {
-                continue;
-            }
-
-            // Diffuse
-            float n = normal.dot(L);
-            if (n > 0) {
-                intensity += light.intensity * n / (normal.mag() * L.mag());
-            }
-
-            // Specular
-            if (specular != -1) {
-                Vec3 R = normal * normal.dot(L) * 2 - L;
-                float rv = R.dot(pointToCamera);
-                if (rv > 0) {
-                    intensity += light.intensity * pow(rv / (R.mag() * pointToCamera.mag()), specular);
-                }
-            }
+    if (!tracePath.empty()) {
+#ifdef RENDER_PROFILE
+        profileStartTrace(TRACE_EVENT_BUDGET);
+#else
+        cout << "Error: --trace needs a build with RENDER_PROFILE (cmake -DRENDER_PROFILE=ON)" << endl;
+        return 1;
+#endif
+    }
+    PROFILE_THREAD_NAME("main");
+
+    if (scenePath.empty()) {
+        buildSceneAccel();
+    } else {
+        auto loadStart = std::chrono::high_resolution_clock::now();
+        if (!loadScene(scenePath)) {
+            return 1;
         }
+        double loadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count();
+        cout << "Loaded " << scenePath << ": " << spheres.size() << " spheres, " << lights.size() << " lights in " << loadMs << " ms" << endl;
     }
-    return intensity;
-}
 
-Vec3 traceRay(Vec3 origin, Vec3 dir, int recursionDepth) {
-    Sphere *closestSphere = closestIntersection(origin, dir, (float)INF);
-    
-    if (closestSphere == nullptr) {
-        return BACKGROUND_COLOR;
-    }
-    
-    float closestT = closestSphere->f;
-    
-    // Compute local color
-    Vec3 P = origin + dir * closestT;
-    Vec3 normal = (P - closestSphere->origin).normalized();
-    Vec3 localColor = closestSphere->color * computeLighting(P, normal, dir * -1, closestSphere->specular);
-
-    // if we hit the recursion limit or the object is not reflective, we're done
-    float r = closestSphere->reflectiveness;
-    if (recursionDepth <= 0 || r <= 0) {
-        return localColor;
+    if (config.randomSpheres > 0 || config.randomLights > 0) {
+        // extra spheres or lights mean a rebuild, so start from an in-memory copy of whatever was loaded
+        sceneSpheres.assign(spheres.begin(), spheres.end());
+        sceneLights.assign(lights.begin(), lights.end());
+        addRandomSpheres(config.randomSpheres);
+        addRandomLights(config.randomLights);
+        buildSceneAccel();
     }
 
-    // compute the reflected color
-    Vec3 R = reflectRay(dir * -1, normal);
-    Vec3 reflectedColor = traceRay(P, R, recursionDepth - 1);
-
-    return localColor * (1 - r) + reflectedColor * r;
-}
-
-void renderTile(SDL_Surface *surface, int startX, int startY, int tileSize) {
-    for (int y = startY; y < startY + tileSize && y < RES_Y; y++) {
-        for (int x = startX; x < startX + tileSize && x < RES_X; x++) {
-            Vec3 rayDir = canvasToViewport(x, y);
-            Vec3 color = traceRay(cameraPos, rayDir, reflectRecursion);
-            color.x = std::min(color.x, 255.0f);
-            color.y = std::min(color.y, 255.0f);
-            color.z = std::min(color.z, 255.0f);
-            Uint32 mappedColor = SDL_MapRGBA(surface->format, color.x, color.y, color.z, 255);
-            setPixel(surface, x, y, mappedColor);
+    for (const std::string &objPath : objPaths) {
+        auto loadStart = std::chrono::high_resolution_clock::now();
+        Mesh mesh;
+        if (!loadOBJ(objPath, mesh)) {
+            return 1;
         }
+        size_t vertexCount = mesh.vertices.size() / 3;
+        buildMeshAccel(mesh);
+        double loadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count();
+        size_t bytes = mesh.bvh.nodes.size() * sizeof(BVHNode) + mesh.blocks.size() * sizeof(TriangleBlock);
+        cout << "Loaded " << objPath << ": " << mesh.triangleCount() << " triangles, " << vertexCount << " vertices in "
+             << loadMs << " ms, " << bytes / mesh.triangleCount() << " bytes per triangle" << endl;
+        meshes.push_back(std::move(mesh));
     }
-}
-
-
-int TILE = 128;
 
-
-
-void drawScene(SDL_Surface *surface) {
-    std::vector<std::future<void>> futures;
-
-    for (int yy = 0; yy < RES_Y; yy += TILE) {
-        for (int xx = 0; xx < RES_X; xx += TILE) {
-            futures.emplace_back(std::async(std::launch::async, renderTile, surface, xx, yy, TILE));
+    if (!saveScenePath.empty()) {
+        bool binary = saveScenePath.size() >= 5 && saveScenePath.compare(saveScenePath.size() - 5, 5, ".rscn") == 0;
+        if (!(binary ? saveBinaryScene(saveScenePath) : saveTextScene(saveScenePath))) {
+            return 1;
+        }
+        if (!bench && !headless && coordinatorAddress.empty() && sequence.path.empty()) {
+            return 0;
         }
     }
+    config.simd = setSimdLevel(config.simd);
+
+    ThreadPool pool(config.threads, config.pin);
+    renderPool = &pool;
 
-    // wait for threads to finish
-    for (auto &f : futures) {
-        f.get();
+    if (!workerAddress.empty()) {
+        // the scene and settings come from the coordinator
+        int status = runWorker(workerAddress);
+        return finishTrace(tracePath) ? status : 1;
+    }
+    if (!coordinatorAddress.empty()) {
+        int status = runCoordinator(config, coordinatorAddress, localWorkers);
+        return finishTrace(tracePath) ? status : 1;
+    }
+    if (!sequence.path.empty()) {
+        int status = renderSequence(config, sequence);
+        return finishTrace(tracePath) ? status : 1;
+    }
+    if (bench || headless) {
+        int status = bench ? runBenchmark(config) : renderHeadless(config);
+        return finishTrace(tracePath) ? status : 1;
     }
-}
 
-void pollKeysPressed() {
-    const Uint8 *state = SDL_GetKeyboardState(NULL);
-    wKeyDown = state[SDL_SCANCODE_W];
-    aKeyDown = state[SDL_SCANCODE_A];
-    sKeyDown = state[SDL_SCANCODE_S];
-    dKeyDown = state[SDL_SCANCODE_D];
-    qKeyDown = state[SDL_SCANCODE_Q];
-    eKeyDown = state[SDL_SCANCODE_E];
-    spaceKeyDown = state[SDL_SCANCODE_SPACE];
-    shiftKeyDown = state[SDL_SCANCODE_LSHIFT];
-    backspaceKeyDown = state[SDL_SCANCODE_BACKSPACE];
-}
+    applyConfig(config);
 
-int main() {
     SDL_Surface *winSurface = NULL;
     SDL_Window *window = NULL;
     SDL_SetHint(SDL_HINT_VIDEO_HIGHDPI_DISABLED, "1");
@@ -363,16 +330,32 @@ int main() {
         return 1;
     }
 
-    smallSphereBoundingSphere = calculateBoundingSphere(spheres, 3); // just the smaller 3 spheres
-
-    std::cout << smallSphereBoundingSphere.origin.x << " " << smallSphereBoundingSphere.origin.y << " " << smallSphereBoundingSphere.origin.z << ", " << smallSphereBoundingSphere.radius << std::endl;
+    // pace to the display's refresh rate unless told otherwise
+    if (refreshRate <= 0) {
+        SDL_DisplayMode mode;
+        int display = SDL_GetWindowDisplayIndex(window);
+        refreshRate = display >= 0 && SDL_GetCurrentDisplayMode(display, &mode) == 0 && mode.refresh_rate > 0 ? mode.refresh_rate : 60;
+    }
 
+    InteractiveRenderer frameRenderer(interactive);
+    FramePipeline pipeline(frameRenderer, winSurface->format->format, RES_X, RES_Y, buffers);
+    if (!pipeline.ok()) {
+        cout << "Error creating frame buffers: " << SDL_GetError() << endl;
+        cin.get();
+        return 1;
+    }
+    FramePacer pacer(1000.0 / refreshRate);
+    Camera camera = cameraState();
     int frameCount = 0;
+#ifdef RENDER_PROFILE
+    RayCounts lastRays;
+#endif
     auto startTime = std::chrono::high_resolution_clock::now();
 
     SDL_Event e;
     bool quit = false;
     while (!quit) {
+        PROFILE_TIMESTAMP(inputStart);
         while (SDL_PollEvent(&e)) {
             if (e.type == SDL_QUIT) {
                 quit = true;
@@ -400,44 +383,69 @@ int main() {
         roll *= rotationSpeed;
 
         // yaw
-        cameraForward = rotateAroundAxis(cameraForward, cameraUp, yaw);
-        cameraRight = rotateAroundAxis(cameraRight, cameraUp, yaw);
+        camera.forward = rotateAroundAxis(camera.forward, camera.up, yaw);
+        camera.right = rotateAroundAxis(camera.right, camera.up, yaw);
 
         // pitch
-        cameraForward = rotateAroundAxis(cameraForward, cameraRight, pitch);
-        cameraUp = rotateAroundAxis(cameraUp, cameraRight, pitch);
+        camera.forward = rotateAroundAxis(camera.forward, camera.right, pitch);
+        camera.up = rotateAroundAxis(camera.up, camera.right, pitch);
 
         // roll
-        cameraUp = rotateAroundAxis(cameraUp, cameraForward, roll);
-        cameraRight = rotateAroundAxis(cameraRight, cameraForward, roll);
+        camera.up = rotateAroundAxis(camera.up, camera.forward, roll);
+        camera.right = rotateAroundAxis(camera.right, camera.forward, roll);
 
 
-        cameraForward = cameraForward.normalized();
-        cameraUp = cameraUp.normalized();
-        cameraRight = cameraRight.normalized();
+        camera.forward = camera.forward.normalized();
+        camera.up = camera.up.normalized();
+        camera.right = camera.right.normalized();
 
         if (backspaceKeyDown) {
-            cameraPos = {0, 0, 0};
+            camera.pos = {0, 0, 0};
         } else {
-            cameraPos = cameraPos + cameraForward * (move * moveSpeed);
+            camera.pos = camera.pos + camera.forward * (move * moveSpeed);
         }
-        
-        frameCount++;
+        bool cameraMoved = yaw != 0 || pitch != 0 || roll != 0 || move != 0 || backspaceKeyDown;
+        PROFILE_STAGE("input", inputStart);
+
         auto currentTime = std::chrono::high_resolution_clock::now();
         auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(currentTime - startTime).count();
 
         if (elapsed >= 1) {
-            std::cout << "FPS: " << frameCount << std::endl;
+            FrameInfo info = pipeline.lastFrameInfo();
+            std::cout << "FPS: " << frameCount << " scale " << info.scale << " samples " << info.samples << std::endl;
+#ifdef RENDER_PROFILE
+            RayCounts rays = rayTotals();
+            RayCounts period = {rays.primary - lastRays.primary, rays.shadow - lastRays.shadow, rays.reflection - lastRays.reflection};
+            lastRays = rays;
+            std::cout << profileStatsLine(period) << std::endl;
+#endif
             frameCount = 0;
             startTime = currentTime;
         }
-        // drawBackground(winSurface);
-        drawScene(winSurface);
-        SDL_UpdateWindowSurface(window);
-        SDL_Delay(8);
+
+        // the workers start on this frame while the previous one is presented
+        pipeline.submit(camera, cameraMoved);
+        SDL_Surface *frame = pipeline.nextFrame();
+        if (frame != nullptr) {
+            // The window surface is SDL's one back buffer, so the render thread
+            // can't draw into it while this thread presents; the pipeline renders
+            // offscreen in the window's format and this same-format copy (a row
+            // memcpy, well under 1% of a frame) is what buys the overlap.
+            {
+                PROFILE_SCOPE("blit");
+                SDL_BlitSurface(frame, NULL, winSurface, NULL);
+            }
+            pipeline.release(frame);
+            PROFILE_SCOPE("present");
+            SDL_UpdateWindowSurface(window);
+            frameCount++;
+        }
+        pacer.wait();
     }
+    pipeline.finish();
+    bool traced = finishTrace(tracePath);
 
     SDL_DestroyWindow(window);
     SDL_Quit();
-    return 0;
+    return traced ? 0 : 1;
 }
@@ -0,0 +1,160 @@
+#include "antialias.h"
+#include "pixelPack.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+AAConfig antialiasing;
+EdgeBuffer *edgeCapture = nullptr;
+
+EdgeBuffer edgeBuffer;
+std::vector<float> edgeScores;
+std::vector<int> edgePixels;
+
+std::atomic<uint64_t> totalAAPixels{0};
+std::atomic<uint64_t> totalEdgePixels{0};
+std::atomic<uint64_t> totalRefinedPixels{0};
+std::atomic<uint64_t> totalExtraSamples{0};
+
+// pixels per job in the refinement pass
+const int REFINE_CHUNK = 64;
+
+void beginEdgeCapture() {
+    size_t pixels = (size_t)RES_X * RES_Y;
+    edgeBuffer.object.resize(pixels);
+    edgeBuffer.normal.resize(pixels);
+    edgeBuffer.color.resize(pixels);
+    edgeCapture = &edgeBuffer;
+}
+
+float luminance(Vec3 c) {
+    return 0.299f * c.x + 0.587f * c.y + 0.114f * c.z;
+}
+
+// 0 for no edge, 1 for a geometric edge, otherwise the luminance step as a fraction of full scale
+float edgeScore(int a, int b, float cosThreshold) {
+    const EdgeBuffer &e = edgeBuffer;
+    if (e.object[a] != e.object[b]) {
+        return 1.0f;
+    }
+    if (e.object[a] >= 0 && e.normal[a].dot(e.normal[b]) < cosThreshold) {
+        return 1.0f;
+    }
+    float step = std::fabs(luminance(e.color[a]) - luminance(e.color[b])) / 255.0f;
+    return step > antialiasing.lumaThreshold ? step : 0.0f;
+}
+
+// well-mixed bits from a pixel and sample index, for the jitter
+uint32_t sampleHash(uint32_t pixel, uint32_t sample) {
+    uint32_t h = pixel * 0x9E3779B1u ^ (sample + 1) * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+    return h;
+}
+
+// jittered position of sample i of n within the pixel, one per cell of a near-square grid
+Vec2 stratifiedOffset(int i, int n, uint32_t pixel) {
+    int cols = (int)std::ceil(std::sqrt((float)n));
+    int rows = (n + cols - 1) / cols;
+    uint32_t h = sampleHash(pixel, i);
+    float jx = (h & 0xFFFF) / 65536.0f;
+    float jy = (h >> 16) / 65536.0f;
+    return {(i % cols + jx) / cols, (i / cols + jy) / rows};
+}
+
+void refinePixel(SDL_Surface *surface, const PixelLayout &layout, int pixel) {
+    int x = pixel % RES_X;
+    int y = pixel / RES_X;
+    int samples = antialiasing.samples;
+    Vec3 sum = edgeBuffer.color[pixel];
+    for (int i = 0; i < samples; i++) {
+        Vec2 offset = stratifiedOffset(i, samples, pixel);
+        Vec3 c = traceRay(cameraPos, cameraRayDir(x + offset.x, y + offset.y), reflectRecursion);
+        sum = sum + Vec3 {std::min(c.x, 255.0f), std::min(c.y, 255.0f), std::min(c.z, 255.0f)};
+    }
+    tileRays.primary += samples;
+
+    Vec3 mean = sum * (1.0f / (samples + 1));
+    Uint32 *out = (Uint32*)((Uint8*)surface->pixels + y * surface->pitch) + x;
+    packRow(&mean.x, &mean.y, &mean.z, 1, layout, out);
+}
+
+void refineEdges(SDL_Surface *surface) {
+    edgeCapture = nullptr;
+    int pixels = RES_X * RES_Y;
+    float cosThreshold = std::cos(antialiasing.normalThreshold * (float)M_PI / 180.0f);
+
+    // score each pixel by the strongest edge it sits on, looking right and down
+    edgeScores.assign(pixels, 0.0f);
+    for (int y = 0; y < RES_Y; y++) {
+        for (int x = 0; x < RES_X; x++) {
+            int a = y * RES_X + x;
+            for (int b : {x + 1 < RES_X ? a + 1 : -1, y + 1 < RES_Y ? a + RES_X : -1}) {
+                if (b < 0) {
+                    continue;
+                }
+                float score = edgeScore(a, b, cosThreshold);
+                edgeScores[a] = std::max(edgeScores[a], score);
+                edgeScores[b] = std::max(edgeScores[b], score);
+            }
+        }
+    }
+
+    edgePixels.clear();
+    for (int i = 0; i < pixels; i++) {
+        if (edgeScores[i] > 0) {
+            edgePixels.push_back(i);
+        }
+    }
+    size_t flagged = edgePixels.size();
+
+    // over budget, keep the strongest edges, then go back to scanline order for locality
+    size_t budget = (size_t)(std::clamp(antialiasing.budget, 0.0f, 1.0f) * pixels);
+    if (edgePixels.size() > budget) {
+        std::nth_element(edgePixels.begin(), edgePixels.begin() + budget, edgePixels.end(),
+            [](int a, int b) { return edgeScores[a] > edgeScores[b]; });
+        edgePixels.resize(budget);
+        std::sort(edgePixels.begin(), edgePixels.end());
+    }
+
+    PixelLayout layout = pixelLayout(surface->format);
+    int chunks = ((int)edgePixels.size() + REFINE_CHUNK - 1) / REFINE_CHUNK;
+    auto refine = [&](int chunk) {
+        tileRays = RayCounts{};
+        int end = std::min((chunk + 1) * REFINE_CHUNK, (int)edgePixels.size());
+        for (int i = chunk * REFINE_CHUNK; i < end; i++) {
+            refinePixel(surface, layout, edgePixels[i]);
+        }
+        // no tile to flush with, so flush the chunk's counts here
+        flushTileRays();
+        PROFILE_FLUSH();
+    };
+    if (renderPool == nullptr) {
+        for (int c = 0; c < chunks; c++) {
+            refine(c);
+        }
+    } else {
+        renderPool->parallelFor(chunks, refine);
+    }
+
+    totalAAPixels += pixels;
+    totalEdgePixels += flagged;
+    totalRefinedPixels += edgePixels.size();
+    totalExtraSamples += (uint64_t)edgePixels.size() * antialiasing.samples;
+}
+
+AAStats aaTotals() {
+    return {totalAAPixels.load(), totalEdgePixels.load(), totalRefinedPixels.load(), totalExtraSamples.load()};
+}
+
+void resetAATotals() {
+    totalAAPixels = 0;
+    totalEdgePixels = 0;
+    totalRefinedPixels = 0;
+    totalExtraSamples = 0;
+}
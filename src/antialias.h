@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "renderer.h"
+
+// Edge-adaptive anti-aliasing. drawScene renders the usual one sample per
+// pixel while recording each pixel's first-hit object, normal and colour;
+// refineEdges then compares every pixel with its right and lower
+// neighbours and spends extra stratified samples only on pixels along an
+// object boundary, a crease or a luminance step. Accumulated (progressive)
+// frames skip it, they are already converging on every pixel.
+
+struct AAConfig {
+    int samples = 0;              // extra samples per edge pixel, 0 turns anti-aliasing off
+    float budget = 0.25f;         // most of the frame's pixels that may get them, strongest edges first
+    float lumaThreshold = 0.03f;  // neighbour luminance step that counts, as a fraction of full scale
+    float normalThreshold = 20.0f; // neighbour normals further apart than this, in degrees, count
+};
+
+// what the one-sample pass saw, one entry per pixel
+struct EdgeBuffer {
+    std::vector<int> object;  // spheres[] index, spheres.size() + mesh, or -1 for a miss
+    std::vector<Vec3> normal;
+    std::vector<Vec3> color;  // clamped to 255
+};
+
+struct AAStats {
+    uint64_t pixels = 0;
+    uint64_t edgePixels = 0;   // pixels flagged, before the budget
+    uint64_t refinedPixels = 0;
+    uint64_t extraSamples = 0;
+};
+
+extern AAConfig antialiasing;
+// set by drawScene while the one-sample pass runs, written by tracePrimaryPacket and storeRow
+extern EdgeBuffer *edgeCapture;
+
+// sizes the edge buffer to the frame and points edgeCapture at it
+void beginEdgeCapture();
+// finds the edges in the captured frame, supersamples them in surface and clears edgeCapture
+void refineEdges(SDL_Surface *surface);
+
+// totals over every refined frame; read them between frames
+AAStats aaTotals();
+void resetAATotals();
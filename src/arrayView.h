@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+
+// Non-owning pointer + count. The renderer reads scene data through these so
+// the same code runs on in-memory vectors and on arrays inside a mapped file.
+template <typename T>
+struct ArrayView {
+    T *ptr = nullptr;
+    int count = 0;
+
+    ArrayView() = default;
+    ArrayView(T *ptr, int count) : ptr(ptr), count(count) {}
+    template <typename U>
+    ArrayView(std::vector<U> &vec) : ptr(vec.data()), count((int)vec.size()) {}
+    template <typename U>
+    ArrayView(const std::vector<U> &vec) : ptr(vec.data()), count((int)vec.size()) {}
+
+    T &operator[](int i) const { return ptr[i]; }
+    T *data() const { return ptr; }
+    T *begin() const { return ptr; }
+    T *end() const { return ptr + count; }
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+};
@@ -0,0 +1,269 @@
+#include "benchmark.h"
+#include "mesh.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using std::cout, std::endl;
+
+struct CameraPose {
+    const char *name;
+    Vec3 pos;
+    float yaw;
+    float pitch;
+};
+
+// fixed so numbers stay comparable between runs and machines
+CameraPose benchPoses[] = {
+    {"front", {0, 0, 0}, 0.0f, 0.0f},
+    {"left", {1, 0.5f, 0}, -0.35f, 0.1f},
+    {"above", {0, 3, 0}, 0.0f, 0.6f},
+    {"close", {0, 0, 2}, 0.2f, 0.0f},
+};
+
+void applyPose(const CameraPose &pose) {
+    resetCamera();
+    cameraForward = rotateAroundAxis(cameraForward, cameraUp, pose.yaw);
+    cameraRight = rotateAroundAxis(cameraRight, cameraUp, pose.yaw);
+    cameraForward = rotateAroundAxis(cameraForward, cameraRight, pose.pitch).normalized();
+    cameraUp = rotateAroundAxis(cameraUp, cameraRight, pose.pitch).normalized();
+    cameraRight = cameraRight.normalized();
+    cameraPos = pose.pos;
+}
+
+void applyConfig(const BenchConfig &config) {
+    setResolution(config.resX, config.resY);
+    reflectRecursion = config.depth;
+    TILE = config.tile;
+    useWavefront = config.wavefront;
+    adaptiveTiles = config.adaptiveTiles;
+    antialiasing = config.aa;
+    setLightCutoff(config.lightCutoff);
+}
+
+void addRandomSpheres(int count) {
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> x(-30.0f, 30.0f);
+    std::uniform_real_distribution<float> y(-0.9f, 8.0f);
+    std::uniform_real_distribution<float> z(6.0f, 80.0f);
+    std::uniform_real_distribution<float> radius(0.05f, 0.3f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    int speculars[] = {-1, 10, 100, 500};
+
+    sceneSpheres.reserve(sceneSpheres.size() + count);
+    for (int i = 0; i < count; i++) {
+        float r = radius(rng);
+        Vec3 color = {unit(rng) * 255, unit(rng) * 255, unit(rng) * 255};
+        sceneSpheres.push_back({{x(rng), y(rng), z(rng)}, color, r, unit(rng) * 0.5f, speculars[rng() % 4], r * r});
+    }
+}
+
+void addRandomLights(int count) {
+    std::mt19937 rng(5678);
+    std::uniform_real_distribution<float> x(-30.0f, 30.0f);
+    std::uniform_real_distribution<float> y(-0.9f, 8.0f);
+    std::uniform_real_distribution<float> z(0.0f, 80.0f);
+    std::uniform_real_distribution<float> intensity(0.1f, 0.4f);
+    std::uniform_real_distribution<float> range(1.0f, 4.0f);
+
+    sceneLights.reserve(sceneLights.size() + count);
+    for (int i = 0; i < count; i++) {
+        // braced initialisers evaluate left to right, so the draws keep their order
+        Light light = {POINT, intensity(rng), {x(rng), y(rng), z(rng)}, range(rng)};
+        sceneLights.push_back(light);
+    }
+}
+
+SDL_Surface *createOffscreenSurface(int resX, int resY) {
+    // plain memory buffer, no video subsystem needed
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, resX, resY, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (!surface) {
+        cout << "Error creating offscreen surface: " << SDL_GetError() << endl;
+    }
+    return surface;
+}
+
+bool writePPM(SDL_Surface *surface, const std::string &path) {
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) {
+        cout << "Error opening " << path << " for writing" << endl;
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", surface->w, surface->h);
+    std::vector<Uint8> row(surface->w * 3);
+    for (int y = 0; y < surface->h; y++) {
+        Uint32 *pixels = (Uint32*)((Uint8*)surface->pixels + y * surface->pitch);
+        for (int x = 0; x < surface->w; x++) {
+            SDL_GetRGB(pixels[x], surface->format, &row[x * 3], &row[x * 3 + 1], &row[x * 3 + 2]);
+        }
+        fwrite(row.data(), 1, row.size(), file);
+    }
+    fclose(file);
+    return true;
+}
+
+bool comparePPM(SDL_Surface *surface, const std::string &path) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        cout << "Error opening " << path << " for reading" << endl;
+        return false;
+    }
+
+    int width = 0, height = 0, maxValue = 0;
+    bool ok = fscanf(file, "P6 %d %d %d", &width, &height, &maxValue) == 3 && fgetc(file) != EOF && maxValue == 255;
+    if (!ok || width != surface->w || height != surface->h) {
+        cout << "Error: " << path << " is not a " << surface->w << "x" << surface->h << " 8-bit PPM" << endl;
+        fclose(file);
+        return false;
+    }
+
+    std::vector<Uint8> expected(width * 3);
+    Uint8 actual[3];
+    int maxDiff = 0;
+    long long differing = 0;
+    for (int y = 0; y < height && ok; y++) {
+        ok = fread(expected.data(), 1, expected.size(), file) == expected.size();
+        Uint32 *pixels = (Uint32*)((Uint8*)surface->pixels + y * surface->pitch);
+        for (int x = 0; x < width && ok; x++) {
+            SDL_GetRGB(pixels[x], surface->format, &actual[0], &actual[1], &actual[2]);
+            for (int c = 0; c < 3; c++) {
+                int diff = std::abs(actual[c] - expected[x * 3 + c]);
+                maxDiff = std::max(maxDiff, diff);
+                differing += diff > 0;
+            }
+        }
+    }
+    fclose(file);
+    if (!ok) {
+        cout << "Error: " << path << " is truncated" << endl;
+        return false;
+    }
+
+    printf("compare %s: max channel difference %d, %lld of %lld channels differ\n",
+        path.c_str(), maxDiff, differing, 3LL * width * height);
+    return differing == 0;
+}
+
+double percentile(const std::vector<double> &sorted, double p) {
+    // nearest rank
+    size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+// coverage of the anti-aliasing pass since the last resetAATotals
+void printAAStats(const char *name) {
+    AAStats aa = aaTotals();
+    if (antialiasing.samples <= 0 || aa.pixels == 0) {
+        return;
+    }
+    printf("%-8s aa       edges %5.1f%%  refined %5.1f%%  extra samples %llu, %.2f per pixel\n",
+        name, 100.0 * aa.edgePixels / aa.pixels, 100.0 * aa.refinedPixels / aa.pixels,
+        (unsigned long long)aa.extraSamples, (double)aa.extraSamples / aa.pixels);
+}
+
+void printFrameStats(const char *name, std::vector<double> times, const RayCounts &rays) {
+    std::sort(times.begin(), times.end());
+    double totalMs = 0;
+    for (double t : times) totalMs += t;
+    double seconds = totalMs / 1000.0;
+
+    printf("%-8s ms/frame min %7.2f  p50 %7.2f  p90 %7.2f  p99 %7.2f  max %7.2f  mean %7.2f\n",
+        name, times.front(), percentile(times, 50), percentile(times, 90), percentile(times, 99),
+        times.back(), totalMs / times.size());
+    printf("%-8s Mrays/s  total %7.2f  primary %7.2f  shadow %7.2f  reflection %7.2f\n",
+        name, (rays.primary + rays.shadow + rays.reflection) / seconds / 1e6,
+        rays.primary / seconds / 1e6, rays.shadow / seconds / 1e6, rays.reflection / seconds / 1e6);
+}
+
+int renderHeadless(const BenchConfig &config) {
+    applyConfig(config);
+    SDL_Surface *surface = createOffscreenSurface(RES_X, RES_Y);
+    if (!surface) {
+        return 1;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    {
+        PROFILE_SCOPE("render");
+        drawScene(surface);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    cout << "Rendered " << RES_X << "x" << RES_Y << " in " << ms << " ms" << endl;
+    printAAStats("frame");
+
+    std::string path = config.ppm.empty() ? "out.ppm" : config.ppm;
+    bool ok = writePPM(surface, path);
+    if (!config.compare.empty()) {
+        ok = comparePPM(surface, config.compare) && ok;
+    }
+    SDL_FreeSurface(surface);
+    return ok ? 0 : 1;
+}
+
+int runBenchmark(const BenchConfig &config) {
+    applyConfig(config);
+    SDL_Surface *surface = createOffscreenSurface(RES_X, RES_Y);
+    if (!surface) {
+        return 1;
+    }
+
+    int triangles = 0;
+    for (const Mesh &mesh : meshes) {
+        triangles += mesh.triangleCount();
+    }
+    printf("benchmark %dx%d reflectRecursion %d TILE %d threads %d simd %s executor %s tiling %s spheres %d lights %d bvh nodes %d triangles %d frames %d\n",
+        RES_X, RES_Y, reflectRecursion, TILE, renderPool ? renderPool->size() : 1, simdLevelName(config.simd),
+        useWavefront ? "wavefront" : "recursive", adaptiveTiles ? "adaptive" : "fixed",
+        spheres.size(), lights.size(), sphereNodes.size(), triangles, config.frames);
+
+    std::vector<double> allTimes;
+    RayCounts allRays;
+    int poseIndex = 0;
+    for (const CameraPose &pose : benchPoses) {
+        applyPose(pose);
+        for (int i = 0; i < config.warmup; i++) {
+            drawScene(surface);
+        }
+
+        std::vector<double> times;
+        resetRayTotals();
+        resetAATotals();
+#ifdef RENDER_PROFILE
+        profileResetStats();
+#endif
+        for (int i = 0; i < config.frames; i++) {
+            PROFILE_SCOPE("render");
+            auto start = std::chrono::high_resolution_clock::now();
+            drawScene(surface);
+            times.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+        }
+        RayCounts rays = rayTotals();
+        printFrameStats(pose.name, times, rays);
+        printAAStats(pose.name);
+#ifdef RENDER_PROFILE
+        printf("%-8s %s\n", pose.name, profileStatsLine(rays).c_str());
+#endif
+
+        allTimes.insert(allTimes.end(), times.begin(), times.end());
+        allRays.primary += rays.primary;
+        allRays.shadow += rays.shadow;
+        allRays.reflection += rays.reflection;
+
+        if (!config.ppm.empty()) {
+            writePPM(surface, config.ppm + "_" + std::to_string(poseIndex) + ".ppm");
+        }
+        poseIndex++;
+    }
+
+    printFrameStats("all", allTimes, allRays);
+    resetCamera();
+    SDL_FreeSurface(surface);
+    return 0;
+}
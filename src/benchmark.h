@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include "renderer.h"
+#include "rayPacket.h"
+#include "antialias.h"
+
+struct BenchConfig {
+    int resX = 500;
+    int resY = 500;
+    int depth = 3;        // reflectRecursion
+    int tile = 32;        // TILE
+    int threads = 0;      // pool workers, 0 = every hardware thread
+    bool pin = false;     // pin pool workers to cores
+    simdLevel simd = SIMD_AVX2; // packet kernel, clamped to what the CPU supports
+    bool wavefront = false; // breadth-first executor instead of recursive traceRay
+    bool adaptiveTiles = false; // cost-guided tiling instead of a fixed TILE grid
+    AAConfig aa;          // edge-adaptive anti-aliasing, off unless aa.samples > 0
+    int frames = 20;      // timed frames per pose
+    int warmup = 2;       // untimed frames per pose
+    int randomSpheres = 0; // extra small spheres scattered in front of the camera
+    int randomLights = 0;  // extra ranged point lights scattered through the same space
+    float lightCutoff = 0.002f; // lights adding less than this at a point are skipped
+    std::string ppm;      // if set, dump the last frame of each pose as <ppm>_<pose>.ppm
+    std::string compare;  // headless: reference PPM the frame must match exactly
+};
+
+// deterministic, so scaling runs stay comparable; call before buildSceneAccel
+void addRandomSpheres(int count);
+void addRandomLights(int count);
+
+// sets resolution, depth, tiling, executor, anti-aliasing and light culling from config
+void applyConfig(const BenchConfig &config);
+
+SDL_Surface *createOffscreenSurface(int resX, int resY);
+bool writePPM(SDL_Surface *surface, const std::string &path);
+// prints how far surface is from the PPM at path; true only if they match exactly
+bool comparePPM(SDL_Surface *surface, const std::string &path);
+
+// renders one frame from the current camera into an offscreen buffer
+int renderHeadless(const BenchConfig &config);
+// renders the fixed pose set and prints ms/frame percentiles and Mrays/s
+int runBenchmark(const BenchConfig &config);
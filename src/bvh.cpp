@@ -0,0 +1,159 @@
+#include "bvh.h"
+
+constexpr int BVH_BINS = 16;
+constexpr int BVH_MAX_SAH_DEPTH = 64; // past this, fall back to median splits
+constexpr float BVH_TRAVERSAL_COST = 1.0f; // relative to one primitive test
+
+struct BVHBuilder {
+    const std::vector<AABB> &bounds;
+    std::vector<Vec3> centroids;
+    BVH &bvh;
+    int maxLeaf;   // larger leaves always get split
+    int leafWidth;
+
+    float leafCost(int count) const {
+        return (float)((count + leafWidth - 1) / leafWidth);
+    }
+
+    float axisOf(const Vec3& v, int axis) const {
+        return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+    }
+
+    void updateBounds(int nodeIndex) {
+        BVHNode &node = bvh.nodes[nodeIndex];
+        AABB box;
+        for (int i = 0; i < node.count; i++) {
+            box.grow(bounds[bvh.primIndices[node.leftFirst + i]]);
+        }
+        node.boundsMin = box.min;
+        node.boundsMax = box.max;
+    }
+
+    // returns the SAH cost of the best binned split, or INFINITY if none exists
+    float findSplit(const BVHNode &node, int &bestAxis, float &bestPos) {
+        AABB centroidBounds;
+        for (int i = 0; i < node.count; i++) {
+            centroidBounds.grow(centroids[bvh.primIndices[node.leftFirst + i]]);
+        }
+
+        float bestCost = INFINITY;
+        for (int axis = 0; axis < 3; axis++) {
+            float lo = axisOf(centroidBounds.min, axis);
+            float hi = axisOf(centroidBounds.max, axis);
+            if (hi <= lo) {
+                continue;
+            }
+
+            AABB binBounds[BVH_BINS];
+            int binCount[BVH_BINS] = {};
+            float scale = BVH_BINS / (hi - lo);
+            for (int i = 0; i < node.count; i++) {
+                int prim = bvh.primIndices[node.leftFirst + i];
+                int bin = std::min(BVH_BINS - 1, (int)((axisOf(centroids[prim], axis) - lo) * scale));
+                binCount[bin]++;
+                binBounds[bin].grow(bounds[prim]);
+            }
+
+            // sweep from both ends so each plane costs O(1)
+            float leftArea[BVH_BINS - 1], rightArea[BVH_BINS - 1];
+            int leftCount[BVH_BINS - 1], rightCount[BVH_BINS - 1];
+            AABB leftBox, rightBox;
+            int leftSum = 0, rightSum = 0;
+            for (int i = 0; i < BVH_BINS - 1; i++) {
+                leftSum += binCount[i];
+                leftCount[i] = leftSum;
+                leftBox.grow(binBounds[i]);
+                leftArea[i] = leftBox.area();
+                rightSum += binCount[BVH_BINS - 1 - i];
+                rightCount[BVH_BINS - 2 - i] = rightSum;
+                rightBox.grow(binBounds[BVH_BINS - 1 - i]);
+                rightArea[BVH_BINS - 2 - i] = rightBox.area();
+            }
+
+            for (int i = 0; i < BVH_BINS - 1; i++) {
+                if (leftCount[i] == 0 || rightCount[i] == 0) {
+                    continue;
+                }
+                float cost = leafCost(leftCount[i]) * leftArea[i] + leafCost(rightCount[i]) * rightArea[i];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestPos = lo + (i + 1) / scale;
+                }
+            }
+        }
+        return bestCost;
+    }
+
+    void subdivide(int nodeIndex, int depth) {
+        BVHNode node = bvh.nodes[nodeIndex];
+        if (node.count <= 1) {
+            return;
+        }
+
+        int axis = 0;
+        float splitPos = 0;
+        float splitCost = INFINITY;
+        if (depth < BVH_MAX_SAH_DEPTH) {
+            splitCost = findSplit(node, axis, splitPos);
+        }
+
+        AABB nodeBox = {node.boundsMin, node.boundsMax};
+        splitCost = BVH_TRAVERSAL_COST + splitCost / std::max(nodeBox.area(), 1e-12f);
+        if (splitCost >= leafCost(node.count) && node.count <= maxLeaf) {
+            return;
+        }
+
+        int *first = &bvh.primIndices[node.leftFirst];
+        int *last = first + node.count;
+        int *mid;
+        if (splitCost != INFINITY) {
+            mid = std::partition(first, last, [&](int prim) { return axisOf(centroids[prim], axis) < splitPos; });
+        } else {
+            // no usable plane (or too deep): median split on the widest axis
+            Vec3 extent = node.boundsMax - node.boundsMin;
+            axis = extent.x > extent.y && extent.x > extent.z ? 0 : extent.y > extent.z ? 1 : 2;
+            mid = first + node.count / 2;
+            std::nth_element(first, mid, last, [&](int a, int b) { return axisOf(centroids[a], axis) < axisOf(centroids[b], axis); });
+        }
+
+        int leftCount = (int)(mid - first);
+        if (leftCount == 0 || leftCount == node.count) {
+            return;
+        }
+
+        int leftIndex = (int)bvh.nodes.size();
+        bvh.nodes.push_back({{}, node.leftFirst, {}, leftCount});
+        bvh.nodes.push_back({{}, node.leftFirst + leftCount, {}, node.count - leftCount});
+        bvh.nodes[nodeIndex].leftFirst = leftIndex;
+        bvh.nodes[nodeIndex].count = 0;
+
+        updateBounds(leftIndex);
+        updateBounds(leftIndex + 1);
+        subdivide(leftIndex, depth + 1);
+        subdivide(leftIndex + 1, depth + 1);
+    }
+};
+
+BVH buildBVH(const std::vector<AABB> &bounds, int maxLeaf, int leafWidth) {
+    BVH bvh;
+    int count = (int)bounds.size();
+    if (count == 0) {
+        return bvh;
+    }
+
+    BVHBuilder builder {bounds, {}, bvh, maxLeaf, leafWidth};
+    builder.centroids.resize(count);
+    bvh.primIndices.resize(count);
+    for (int i = 0; i < count; i++) {
+        builder.centroids[i] = (bounds[i].min + bounds[i].max) * 0.5f;
+        bvh.primIndices[i] = i;
+    }
+
+    bvh.nodes.reserve(2 * count - 1);
+    bvh.nodes.push_back({{}, 0, {}, count});
+    builder.updateBounds(0);
+    builder.subdivide(0, 0);
+    bvh.nodes.shrink_to_fit();
+    return bvh;
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "arrayView.h"
+#include "renderer.h"
+#include "profiler.h"
+
+struct AABB {
+    Vec3 min = {INFINITY, INFINITY, INFINITY};
+    Vec3 max = {-INFINITY, -INFINITY, -INFINITY};
+
+    void grow(const Vec3& p) {
+        min = {std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z)};
+        max = {std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z)};
+    }
+    void grow(const AABB& o) {
+        grow(o.min);
+        grow(o.max);
+    }
+    float area() const {
+        Vec3 e = max - min;
+        return e.x < 0 ? 0 : 2 * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+};
+
+// 32 bytes, two per cache line. Interior nodes have count == 0 and their
+// children at leftFirst and leftFirst + 1; leaves cover the primitives
+// [leftFirst, leftFirst + count) of the build order.
+struct BVHNode {
+    Vec3 boundsMin;
+    int leftFirst;
+    Vec3 boundsMax;
+    int count;
+};
+
+// build output
+struct BVH {
+    std::vector<BVHNode> nodes;
+    std::vector<int> primIndices; // build order -> caller's primitive index
+};
+
+// what traversal reads, so nodes can also live in a mapped scene file
+typedef ArrayView<const BVHNode> BVHNodes;
+
+// SAH build over binned centroids; works for any primitive that has bounds.
+// Leaves hold at most maxLeaf primitives. leafWidth is how many primitives one
+// leaf test covers (the SIMD width of the leaf kernel), so a leaf of n costs
+// ceil(n / leafWidth) in the SAH.
+BVH buildBVH(const std::vector<AABB> &bounds, int maxLeaf = 4, int leafWidth = 1);
+
+// over spheres[], which is kept in build order
+extern BVHNodes sphereNodes;
+
+// ray/box slab test, returns the entry distance or INFINITY on a miss
+inline float intersectAABB(const Vec3& origin, const Vec3& invDir, const Vec3& bMin, const Vec3& bMax, float tMax) {
+    float tx1 = (bMin.x - origin.x) * invDir.x, tx2 = (bMax.x - origin.x) * invDir.x;
+    float tNear = std::min(tx1, tx2), tFar = std::max(tx1, tx2);
+    float ty1 = (bMin.y - origin.y) * invDir.y, ty2 = (bMax.y - origin.y) * invDir.y;
+    tNear = std::max(tNear, std::min(ty1, ty2)), tFar = std::min(tFar, std::max(ty1, ty2));
+    float tz1 = (bMin.z - origin.z) * invDir.z, tz2 = (bMax.z - origin.z) * invDir.z;
+    tNear = std::max(tNear, std::min(tz1, tz2)), tFar = std::min(tFar, std::max(tz1, tz2));
+    return (tFar >= tNear && tNear < tMax && tFar > 0) ? tNear : INFINITY;
+}
+
+inline Vec3 inverseDir(const Vec3& dir) {
+    return {1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z};
+}
+
+// enough for 64 SAH levels plus median splits below them
+constexpr int BVH_STACK_SIZE = 128;
+
+// Visits leaves front to back. intersect(leaf, tMax) tests the leaf's
+// primitives and shrinks tMax on a closer hit.
+template <typename Intersect>
+void bvhClosestHit(BVHNodes nodes, const Vec3& origin, const Vec3& dir, float &tMax, Intersect intersect) {
+    if (nodes.empty()) {
+        return;
+    }
+    Vec3 invDir = inverseDir(dir);
+    const BVHNode *stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    const BVHNode *node = &nodes[0];
+    if (intersectAABB(origin, invDir, node->boundsMin, node->boundsMax, tMax) == INFINITY) {
+        PROFILE_COUNT(nodeCulls);
+        return;
+    }
+
+    while (true) {
+        if (node->count > 0) {
+            intersect(*node, tMax);
+        } else {
+            const BVHNode *near = &nodes[node->leftFirst];
+            const BVHNode *far = near + 1;
+            float tNear = intersectAABB(origin, invDir, near->boundsMin, near->boundsMax, tMax);
+            float tFar = intersectAABB(origin, invDir, far->boundsMin, far->boundsMax, tMax);
+            if (tFar < tNear) {
+                std::swap(near, far);
+                std::swap(tNear, tFar);
+            }
+            PROFILE_ADD(nodeCulls, (tNear == INFINITY) + (tFar == INFINITY));
+            if (tNear != INFINITY) {
+                if (tFar != INFINITY) {
+                    stack[stackSize++] = far;
+                }
+                node = near;
+                continue;
+            }
+        }
+
+        // pop, skipping nodes that a closer hit has since ruled out
+        while (true) {
+            if (stackSize == 0) {
+                return;
+            }
+            node = stack[--stackSize];
+            if (intersectAABB(origin, invDir, node->boundsMin, node->boundsMax, tMax) != INFINITY) {
+                break;
+            }
+            PROFILE_COUNT(nodeCulls);
+        }
+    }
+}
+
+// Stops at the first leaf for which occluded(leaf) returns true.
+template <typename Occluded>
+bool bvhAnyHit(BVHNodes nodes, const Vec3& origin, const Vec3& dir, float tMax, Occluded occluded) {
+    if (nodes.empty()) {
+        return false;
+    }
+    Vec3 invDir = inverseDir(dir);
+    const BVHNode *stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = &nodes[0];
+
+    while (stackSize > 0) {
+        const BVHNode *node = stack[--stackSize];
+        if (intersectAABB(origin, invDir, node->boundsMin, node->boundsMax, tMax) == INFINITY) {
+            PROFILE_COUNT(nodeCulls);
+            continue;
+        }
+        if (node->count > 0) {
+            if (occluded(*node)) {
+                return true;
+            }
+        } else {
+            stack[stackSize++] = &nodes[node->leftFirst + 1];
+            stack[stackSize++] = &nodes[node->leftFirst];
+        }
+    }
+    return false;
+}
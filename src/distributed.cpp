@@ -0,0 +1,788 @@
+#include "distributed.h"
+#include "mesh.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using std::cout, std::endl;
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t PROTOCOL_VERSION = 3;
+
+const int MAX_TILE_ATTEMPTS = 3;       // then the coordinator renders it
+const int TILE_TIMEOUT_MS = 30000;     // a worker holding a tile this long is dropped
+const int WORKER_WAIT_MS = 10000;      // with no workers for this long, render the rest locally
+const int HELLO_TIMEOUT_MS = 5000;     // a connection that hasn't said hello by then is closed
+const int CONNECT_TIMEOUT_MS = 10000;  // how long a worker keeps retrying the coordinator
+const uint64_t MAX_SCENE_BYTES = 1ull << 30; // a worker refuses larger scenes rather than allocate them
+const int MAX_RESOLUTION = 16384;      // per axis, and the largest tile a worker accepts
+
+enum MessageType : uint32_t {
+    MSG_HELLO,  // worker -> coordinator: WorkerHello
+    MSG_SCENE,  // coordinator -> worker: SceneHeader, spheres, lights, then per mesh MeshHeader, BVH nodes, triangle blocks
+    MSG_TILE,   // coordinator -> worker: int32 tile index
+    MSG_PIXELS, // worker -> coordinator: int32 tile index, then the tile's pixels row by row
+    MSG_DONE,   // coordinator -> worker: frame finished, exit
+};
+
+struct MessageHeader {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t size; // payload bytes after the header
+};
+
+struct WorkerHello {
+    uint32_t version;
+    int32_t threads;
+};
+
+struct SceneHeader {
+    int32_t resX, resY;
+    int32_t tile;
+    int32_t depth;
+    int32_t fov;
+    int32_t wavefront;
+    float lightCutoff;
+    Camera camera;
+    uint32_t numSpheres;
+    uint32_t numLights;
+    uint32_t numMeshes;
+};
+
+struct MeshHeader {
+    uint64_t numNodes;
+    uint64_t numBlocks;
+    int32_t triangles;
+    Vec3 color;
+    int32_t specular;
+    float reflectiveness;
+};
+
+// sockets
+
+bool parseAddress(const std::string &address, bool &isUnix, std::string &host, std::string &port) {
+    if (address.compare(0, 5, "unix:") == 0) {
+        isUnix = true;
+        host = address.substr(5);
+        return !host.empty() && host.size() < sizeof(sockaddr_un::sun_path);
+    }
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon + 1 == address.size()) {
+        return false;
+    }
+    isUnix = false;
+    host = address.substr(0, colon);
+    port = address.substr(colon + 1);
+    return true;
+}
+
+// replies go out as soon as a tile is done rather than waiting on Nagle
+void setNoDelay(int fd) {
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)); // fails harmlessly on Unix sockets
+}
+
+sockaddr_un unixAddress(const std::string &path) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+int listenOn(const std::string &address) {
+    bool isUnix;
+    std::string host, port;
+    if (!parseAddress(address, isUnix, host, port)) {
+        cout << "Error: bad address " << address << ", expected unix:<path> or <host>:<port>" << endl;
+        return -1;
+    }
+
+    if (isUnix) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr = unixAddress(host);
+        unlink(host.c_str());
+        if (fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+            cout << "Error listening on " << address << ": " << strerror(errno) << endl;
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo *result;
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result) != 0) {
+        cout << "Error resolving " << address << endl;
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo *ai = result; ai != nullptr && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        int yes = 1;
+        if (fd >= 0 && (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) < 0 ||
+                        bind(fd, ai->ai_addr, ai->ai_addrlen) < 0 || listen(fd, 64) < 0)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(result);
+    if (fd < 0) {
+        cout << "Error listening on " << address << ": " << strerror(errno) << endl;
+    }
+    return fd;
+}
+
+int connectOnce(const std::string &address) {
+    bool isUnix;
+    std::string host, port;
+    if (!parseAddress(address, isUnix, host, port)) {
+        return -1;
+    }
+    if (isUnix) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr = unixAddress(host);
+        if (fd >= 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            fd = -1;
+        }
+        return fd;
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *result;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo *ai = result; ai != nullptr && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(result);
+    if (fd >= 0) {
+        setNoDelay(fd);
+    }
+    return fd;
+}
+
+bool sendAll(int fd, const void *data, size_t size) {
+    const char *p = (const char*)data;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool recvAll(int fd, void *data, size_t size) {
+    char *p = (char*)data;
+    while (size > 0) {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool sendMessage(int fd, MessageType type, const void *payload, size_t size) {
+    // header and payload in one segment where possible; tile requests are tiny
+    MessageHeader header = {type, 0, size};
+    iovec parts[2] = {{&header, sizeof(header)}, {(void*)payload, size}};
+    msghdr message = {};
+    message.msg_iov = parts;
+    message.msg_iovlen = size > 0 ? 2 : 1;
+    ssize_t n;
+    do {
+        n = sendmsg(fd, &message, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return false;
+    }
+    // finish off a partial send
+    if ((size_t)n < sizeof(header)) {
+        return sendAll(fd, (char*)&header + n, sizeof(header) - n) && sendAll(fd, payload, size);
+    }
+    n -= sizeof(header);
+    return sendAll(fd, (const char*)payload + n, size - n);
+}
+
+// false on a closed socket or a payload larger than maxSize
+bool recvMessage(int fd, MessageType &type, std::vector<char> &payload, uint64_t maxSize) {
+    MessageHeader header;
+    if (!recvAll(fd, &header, sizeof(header)) || header.size > maxSize) {
+        return false;
+    }
+    type = (MessageType)header.type;
+    payload.resize(header.size);
+    return recvAll(fd, payload.data(), payload.size());
+}
+
+template <typename T>
+void append(std::vector<char> &buffer, const T *data, size_t count) {
+    const char *p = (const char*)data;
+    buffer.insert(buffer.end(), p, p + count * sizeof(T));
+}
+
+// reads count Ts at offset, false if the payload is too short
+template <typename T>
+bool take(const std::vector<char> &buffer, size_t &offset, T *data, size_t count) {
+    size_t bytes = count * sizeof(T);
+    if (bytes > buffer.size() - offset) {
+        return false;
+    }
+    memcpy((void*)data, buffer.data() + offset, bytes);
+    offset += bytes;
+    return true;
+}
+
+// tiles in drawScene's order and shape
+
+int tileCountFor() {
+    return ((RES_X + TILE - 1) / TILE) * ((RES_Y + TILE - 1) / TILE);
+}
+
+void tileRect(int tile, int &x, int &y, int &w, int &h) {
+    int tilesX = (RES_X + TILE - 1) / TILE;
+    x = (tile % tilesX) * TILE;
+    y = (tile / tilesX) * TILE;
+    w = std::min(TILE, RES_X - x);
+    h = std::min(TILE, RES_Y - y);
+}
+
+// scene transfer
+
+std::vector<char> encodeScene() {
+    SceneHeader header = {RES_X, RES_Y, TILE, reflectRecursion, FOV, useWavefront, lightCutoff, cameraState(),
+                          (uint32_t)spheres.size(), (uint32_t)lights.size(), (uint32_t)meshes.size()};
+    std::vector<char> buffer;
+    append(buffer, &header, 1);
+    append(buffer, spheres.data(), spheres.size());
+    append(buffer, lights.data(), lights.size());
+    for (const Mesh &mesh : meshes) {
+        MeshHeader meshHeader = {mesh.bvh.nodes.size(), mesh.blocks.size(), mesh.triangles, mesh.color, mesh.specular,
+                                 mesh.reflectiveness};
+        append(buffer, &meshHeader, 1);
+        append(buffer, mesh.bvh.nodes.data(), mesh.bvh.nodes.size());
+        append(buffer, mesh.blocks.data(), mesh.blocks.size());
+    }
+    return buffer;
+}
+
+// children after their parent and inside the node array, leaves inside blocks
+bool validMeshTree(const Mesh &mesh) {
+    const std::vector<BVHNode> &nodes = mesh.bvh.nodes;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const BVHNode &node = nodes[i];
+        bool valid = node.count > 0
+            ? node.leftFirst >= 0 && (uint64_t)node.leftFirst + (node.count + TRI_BLOCK_SIZE - 1) / TRI_BLOCK_SIZE <= mesh.blocks.size()
+            : node.count == 0 && node.leftFirst > (int64_t)i && (uint64_t)node.leftFirst + 1 < nodes.size();
+        if (!valid) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool decodeScene(const std::vector<char> &buffer) {
+    size_t offset = 0;
+    SceneHeader header;
+    if (!take(buffer, offset, &header, 1)) {
+        return false;
+    }
+    // tiling divides by these, and the worker allocates a frame of this size
+    if (header.resX <= 0 || header.resX > MAX_RESOLUTION || header.resY <= 0 || header.resY > MAX_RESOLUTION ||
+        header.tile <= 0 || header.tile > MAX_RESOLUTION) {
+        return false;
+    }
+    // counts come off the wire, so check they fit before allocating for them
+    size_t left = buffer.size() - offset;
+    if (header.numSpheres > left / sizeof(Sphere) || header.numLights > (left - header.numSpheres * sizeof(Sphere)) / sizeof(Light)) {
+        return false;
+    }
+    sceneSpheres.resize(header.numSpheres);
+    sceneLights.resize(header.numLights);
+    if (!take(buffer, offset, sceneSpheres.data(), sceneSpheres.size()) ||
+        !take(buffer, offset, sceneLights.data(), sceneLights.size())) {
+        return false;
+    }
+    meshes.clear();
+    for (uint32_t i = 0; i < header.numMeshes; i++) {
+        MeshHeader meshHeader;
+        Mesh mesh;
+        if (!take(buffer, offset, &meshHeader, 1)) {
+            return false;
+        }
+        // the built mesh as is, so a worker skips the rebuild and traces the same tree
+        left = buffer.size() - offset;
+        if (meshHeader.numNodes > left / sizeof(BVHNode) || meshHeader.numBlocks > left / sizeof(TriangleBlock)) {
+            return false;
+        }
+        mesh.bvh.nodes.resize(meshHeader.numNodes);
+        mesh.blocks.resize(meshHeader.numBlocks);
+        if (!take(buffer, offset, mesh.bvh.nodes.data(), mesh.bvh.nodes.size()) ||
+            !take(buffer, offset, mesh.blocks.data(), mesh.blocks.size()) || !validMeshTree(mesh)) {
+            return false;
+        }
+        mesh.triangles = meshHeader.triangles;
+        mesh.color = meshHeader.color;
+        mesh.specular = meshHeader.specular;
+        mesh.reflectiveness = meshHeader.reflectiveness;
+        meshes.push_back(std::move(mesh));
+    }
+
+    // spheres arrive in the coordinator's BVH leaf order, so the rebuild reproduces its tree
+    buildSceneAccel();
+    setResolution(header.resX, header.resY);
+    setFov(header.fov);
+    TILE = header.tile;
+    reflectRecursion = header.depth;
+    useWavefront = header.wavefront != 0;
+    setLightCutoff(header.lightCutoff);
+    applyCamera(header.camera);
+    return true;
+}
+
+// worker
+
+int runWorker(const std::string &address) {
+    int fd = -1;
+    auto deadline = Clock::now() + std::chrono::milliseconds(CONNECT_TIMEOUT_MS);
+    while ((fd = connectOnce(address)) < 0 && Clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if (fd < 0) {
+        cout << "Error connecting to coordinator at " << address << endl;
+        return 1;
+    }
+
+    WorkerHello hello = {PROTOCOL_VERSION, renderPool != nullptr ? std::max(renderPool->size(), 1) : 1};
+    MessageType type;
+    std::vector<char> payload;
+    if (!sendMessage(fd, MSG_HELLO, &hello, sizeof(hello)) || !recvMessage(fd, type, payload, MAX_SCENE_BYTES) || type != MSG_SCENE ||
+        !decodeScene(payload)) {
+        cout << "Error receiving the scene from " << address << endl;
+        close(fd);
+        return 1;
+    }
+    prepareShading();
+
+    SDL_Surface *surface = createOffscreenSurface(RES_X, RES_Y);
+    if (!surface) {
+        close(fd);
+        return 1;
+    }
+
+    // renders whatever tiles have queued up as one batch on the pool
+    std::vector<int> batch;
+    std::vector<char> reply;
+    bool ok = true;
+    while (ok && recvMessage(fd, type, payload, sizeof(int32_t)) && type == MSG_TILE) {
+        batch.clear();
+        while (ok && type == MSG_TILE) {
+            int32_t tile;
+            size_t offset = 0;
+            ok = take(payload, offset, &tile, 1) && tile >= 0 && tile < tileCountFor();
+            batch.push_back(tile);
+            pollfd waiting = {fd, POLLIN, 0};
+            if (!ok || poll(&waiting, 1, 0) <= 0) {
+                break;
+            }
+            ok = recvMessage(fd, type, payload, sizeof(int32_t));
+        }
+        if (!ok) {
+            break;
+        }
+
+        auto render = [&](int i) {
+            int x, y, w, h;
+            tileRect(batch[i], x, y, w, h);
+            renderTile(surface, x, y, TILE);
+        };
+        if (renderPool != nullptr) {
+            renderPool->parallelFor((int)batch.size(), render);
+        } else {
+            for (int i = 0; i < (int)batch.size(); i++) {
+                render(i);
+            }
+        }
+
+        for (int32_t tile : batch) {
+            int x, y, w, h;
+            tileRect(tile, x, y, w, h);
+            reply.clear();
+            append(reply, &tile, 1);
+            for (int row = y; row < y + h; row++) {
+                append(reply, (Uint32*)((Uint8*)surface->pixels + row * surface->pitch) + x, w);
+            }
+            ok = ok && sendMessage(fd, MSG_PIXELS, reply.data(), reply.size());
+        }
+        if (type != MSG_TILE) {
+            break; // the last read was MSG_DONE
+        }
+    }
+
+    SDL_FreeSurface(surface);
+    close(fd);
+    return ok ? 0 : 1;
+}
+
+// coordinator
+
+struct WorkerConnection {
+    int fd;
+    int id;
+    int capacity = 0;            // tiles kept in flight, 0 until the hello arrives
+    std::vector<char> inbox;     // bytes received but not yet parsed
+    std::deque<std::pair<int, Clock::time_point>> inFlight; // tile, when it was sent
+
+    int tiles = 0;
+    uint64_t pixels = 0;
+    Clock::time_point connected;
+    Clock::time_point lastResult;
+    bool failed = false;
+};
+
+struct Coordinator {
+    SDL_Surface *frame;
+    std::vector<char> scene;
+    std::deque<int> pending;
+    std::vector<int> attempts;
+    std::vector<bool> done;
+    std::vector<int> localTiles;
+    int tilesDone = 0;
+    int retries = 0;
+    std::vector<std::unique_ptr<WorkerConnection>> workers;
+    std::vector<std::unique_ptr<WorkerConnection>> finished; // kept for the report
+
+    void finishTile(int tile) {
+        done[tile] = true;
+        tilesDone++;
+    }
+
+    // puts a failed tile back, or hands it to the coordinator once it runs out of attempts
+    void retry(int tile) {
+        if (done[tile]) {
+            return;
+        }
+        retries++;
+        if (++attempts[tile] >= MAX_TILE_ATTEMPTS) {
+            localTiles.push_back(tile);
+            finishTile(tile);
+        } else {
+            pending.push_front(tile);
+        }
+    }
+
+    void drop(WorkerConnection &worker, const char *reason) {
+        if (worker.capacity == 0) {
+            cout << "Connection " << worker.id << " closed (" << reason << ")" << endl;
+            worker.failed = true;
+            close(worker.fd);
+            return;
+        }
+        cout << "Worker " << worker.id << " dropped (" << reason << "), retrying " << worker.inFlight.size() << " tiles" << endl;
+        for (auto &assignment : worker.inFlight) {
+            retry(assignment.first);
+        }
+        worker.inFlight.clear();
+        worker.failed = true;
+        close(worker.fd);
+    }
+
+    // parses whole messages out of the inbox; false on a protocol error
+    bool handleMessages(WorkerConnection &worker) {
+        // the largest legal message is a full tile of pixels
+        uint64_t maxSize = std::max(sizeof(WorkerHello), sizeof(int32_t) + (size_t)TILE * TILE * sizeof(Uint32));
+        size_t offset = 0;
+        while (worker.inbox.size() - offset >= sizeof(MessageHeader)) {
+            MessageHeader header;
+            memcpy(&header, worker.inbox.data() + offset, sizeof(header));
+            if (header.size > maxSize) {
+                return false;
+            }
+            if (worker.inbox.size() - offset - sizeof(header) < header.size) {
+                break;
+            }
+            const char *payload = worker.inbox.data() + offset + sizeof(header);
+            offset += sizeof(header) + header.size;
+
+            if (header.type == MSG_HELLO && worker.capacity == 0 && header.size == sizeof(WorkerHello)) {
+                WorkerHello hello;
+                memcpy(&hello, payload, sizeof(hello));
+                if (hello.version != PROTOCOL_VERSION || !sendMessage(worker.fd, MSG_SCENE, scene.data(), scene.size())) {
+                    return false;
+                }
+                // two tiles per thread, so the next batch is already waiting when one finishes
+                worker.capacity = std::max(hello.threads, 1) * 2;
+            } else if (header.type == MSG_PIXELS && header.size >= sizeof(int32_t)) {
+                int32_t tile;
+                memcpy(&tile, payload, sizeof(tile));
+                auto it = std::find_if(worker.inFlight.begin(), worker.inFlight.end(), [&](auto &a) { return a.first == tile; });
+                int x, y, w, h;
+                if (it == worker.inFlight.end()) {
+                    return false;
+                }
+                tileRect(tile, x, y, w, h);
+                if (header.size != sizeof(int32_t) + (uint64_t)w * h * sizeof(Uint32)) {
+                    return false;
+                }
+                worker.inFlight.erase(it);
+                if (!done[tile]) {
+                    const Uint32 *pixels = (const Uint32*)(payload + sizeof(int32_t));
+                    for (int row = 0; row < h; row++) {
+                        memcpy((Uint32*)((Uint8*)frame->pixels + (y + row) * frame->pitch) + x, pixels + row * w, w * sizeof(Uint32));
+                    }
+                    finishTile(tile);
+                    worker.tiles++;
+                    worker.pixels += (uint64_t)w * h;
+                    worker.lastResult = Clock::now();
+                }
+            } else {
+                return false;
+            }
+        }
+        worker.inbox.erase(worker.inbox.begin(), worker.inbox.begin() + offset);
+        return true;
+    }
+
+    void assignTiles(WorkerConnection &worker) {
+        while ((int)worker.inFlight.size() < worker.capacity && !pending.empty()) {
+            int32_t tile = pending.front();
+            if (done[tile]) {
+                pending.pop_front();
+                continue;
+            }
+            if (!sendMessage(worker.fd, MSG_TILE, &tile, sizeof(tile))) {
+                drop(worker, "send failed");
+                return;
+            }
+            pending.pop_front();
+            worker.inFlight.push_back({tile, Clock::now()});
+        }
+    }
+};
+
+// starts a worker process of this binary pointed at address
+pid_t spawnWorker(const std::string &address, int threads) {
+    std::string threadArg = std::to_string(threads);
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl("/proc/self/exe", "Renderer", "--worker", address.c_str(), "--threads", threadArg.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    if (pid < 0) {
+        cout << "Error starting a worker: " << strerror(errno) << endl;
+    }
+    return pid;
+}
+
+int runCoordinator(const BenchConfig &config, const std::string &address, int localWorkers) {
+    applyConfig(config);
+    Coordinator c;
+    c.frame = createOffscreenSurface(RES_X, RES_Y);
+    if (!c.frame) {
+        return 1;
+    }
+    int listenFd = listenOn(address);
+    if (listenFd < 0) {
+        SDL_FreeSurface(c.frame);
+        return 1;
+    }
+
+    int tileCount = tileCountFor();
+    c.scene = encodeScene();
+    c.attempts.assign(tileCount, 0);
+    c.done.assign(tileCount, false);
+    for (int t = 0; t < tileCount; t++) {
+        c.pending.push_back(t);
+    }
+
+    auto start = Clock::now();
+    std::vector<pid_t> children;
+    int hardwareThreads = std::max(1, (int)std::thread::hardware_concurrency());
+    for (int i = 0; i < localWorkers; i++) {
+        // share the machine between the local workers unless told otherwise
+        pid_t pid = spawnWorker(address, config.threads > 0 ? config.threads : std::max(1, hardwareThreads / localWorkers));
+        if (pid > 0) {
+            children.push_back(pid);
+        }
+    }
+    cout << "Coordinating " << tileCount << " tiles on " << address << " with " << children.size() << " local workers" << endl;
+
+    int nextId = 0;
+    auto lastWorkerSeen = Clock::now();
+    std::vector<pollfd> fds;
+    std::vector<char> chunk(1 << 16);
+    while (c.tilesDone < tileCount) {
+        for (auto &worker : c.workers) {
+            if (!worker->failed && worker->capacity > 0) {
+                c.assignTiles(*worker);
+            }
+        }
+
+        // move dropped workers aside; connections that never said hello weren't workers
+        for (auto it = c.workers.begin(); it != c.workers.end();) {
+            if ((*it)->failed) {
+                if ((*it)->capacity > 0) {
+                    c.finished.push_back(std::move(*it));
+                }
+                it = c.workers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        auto now = Clock::now();
+        if (std::any_of(c.workers.begin(), c.workers.end(), [](auto &worker) { return worker->capacity > 0; })) {
+            lastWorkerSeen = now;
+        } else if (now - lastWorkerSeen > std::chrono::milliseconds(WORKER_WAIT_MS)) {
+            cout << "No workers for " << WORKER_WAIT_MS / 1000 << " s, rendering " << c.pending.size() << " tiles locally" << endl;
+            for (int tile : c.pending) {
+                if (!c.done[tile]) {
+                    c.localTiles.push_back(tile);
+                    c.finishTile(tile);
+                }
+            }
+            c.pending.clear();
+            break;
+        }
+
+        fds.assign(1, {listenFd, POLLIN, 0});
+        for (auto &worker : c.workers) {
+            fds.push_back({worker->fd, POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), 100) < 0 && errno != EINTR) {
+            cout << "Error polling workers: " << strerror(errno) << endl;
+            break;
+        }
+
+        for (size_t i = 1; i < fds.size(); i++) {
+            WorkerConnection &worker = *c.workers[i - 1];
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            ssize_t n = recv(worker.fd, chunk.data(), chunk.size(), 0);
+            if (n <= 0) {
+                c.drop(worker, n == 0 ? "disconnected" : strerror(errno));
+                continue;
+            }
+            worker.inbox.insert(worker.inbox.end(), chunk.begin(), chunk.begin() + n);
+            if (!c.handleMessages(worker)) {
+                c.drop(worker, "protocol error");
+            }
+        }
+
+        now = Clock::now();
+        for (auto &worker : c.workers) {
+            if (!worker->failed && !worker->inFlight.empty() &&
+                now - worker->inFlight.front().second > std::chrono::milliseconds(TILE_TIMEOUT_MS)) {
+                c.drop(*worker, "tile timed out");
+            } else if (!worker->failed && worker->capacity == 0 &&
+                       now - worker->connected > std::chrono::milliseconds(HELLO_TIMEOUT_MS)) {
+                c.drop(*worker, "no hello");
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd >= 0) {
+                setNoDelay(fd);
+                c.workers.push_back(std::make_unique<WorkerConnection>());
+                c.workers.back()->fd = fd;
+                c.workers.back()->id = nextId++;
+                c.workers.back()->connected = Clock::now();
+            }
+        }
+    }
+
+    // tiles nobody could render
+    if (!c.localTiles.empty()) {
+        prepareShading();
+        auto render = [&](int i) {
+            int x, y, w, h;
+            tileRect(c.localTiles[i], x, y, w, h);
+            renderTile(c.frame, x, y, TILE);
+        };
+        if (renderPool != nullptr) {
+            renderPool->parallelFor((int)c.localTiles.size(), render);
+        } else {
+            for (int i = 0; i < (int)c.localTiles.size(); i++) {
+                render(i);
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (auto &worker : c.workers) {
+        // dropped workers are already closed, and their fd may have been reused
+        if (!worker->failed) {
+            sendMessage(worker->fd, MSG_DONE, nullptr, 0);
+            close(worker->fd);
+        }
+        if (worker->capacity > 0) {
+            c.finished.push_back(std::move(worker));
+        }
+    }
+    close(listenFd);
+    bool isUnix;
+    std::string host, port;
+    if (parseAddress(address, isUnix, host, port) && isUnix) {
+        unlink(host.c_str());
+    }
+    for (pid_t pid : children) {
+        waitpid(pid, nullptr, 0);
+    }
+
+    std::sort(c.finished.begin(), c.finished.end(), [](auto &a, auto &b) { return a->id < b->id; });
+    printf("Rendered %dx%d in %.1f ms, %d tiles, %d retried, %d rendered locally\n",
+        RES_X, RES_Y, seconds * 1000, tileCount, c.retries, (int)c.localTiles.size());
+    for (auto &worker : c.finished) {
+        double active = std::chrono::duration<double>(worker->lastResult - worker->connected).count();
+        printf("worker %2d  tiles %5d  %5.1f%% of frame  %7.2f Mpixels/s%s\n", worker->id, worker->tiles,
+            100.0 * worker->pixels / ((double)RES_X * RES_Y), worker->tiles > 0 && active > 0 ? worker->pixels / active / 1e6 : 0.0,
+            worker->failed ? "  (dropped)" : "");
+    }
+
+    std::string path = config.ppm.empty() ? "out.ppm" : config.ppm;
+    bool ok = writePPM(c.frame, path);
+    SDL_FreeSurface(c.frame);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include "benchmark.h"
+
+// Renders one frame across processes. The coordinator holds the scene and
+// the framebuffer; workers connect, receive the scene, and render the tiles
+// they are handed (the same TILE units drawScene uses) with their own pool.
+// A worker that disconnects, errors or sits on a tile past the timeout is
+// dropped and its tiles go back in the queue. A tile that keeps failing, or
+// that nobody is left to take, is rendered by the coordinator itself.
+//
+// Addresses are "unix:<socket path>" or "<host>:<port>". Messages are native
+// endian with the renderer's own struct layouts, so every process must run
+// the same build.
+
+// Listens on address, starts localWorkers worker processes of this binary,
+// renders the current scene and camera at config's settings and writes
+// config.ppm (out.ppm if unset). Prints per-worker throughput.
+int runCoordinator(const BenchConfig &config, const std::string &address, int localWorkers);
+
+// Connects to a coordinator and renders tiles until it says the frame is done.
+int runWorker(const std::string &address);
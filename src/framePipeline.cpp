@@ -0,0 +1,132 @@
+#include "framePipeline.h"
+#include "profiler.h"
+
+FramePipeline::FramePipeline(InteractiveRenderer &renderer, Uint32 pixelFormat, int width, int height, int bufferCount)
+    : renderer(renderer) {
+    for (int i = 0; i < bufferCount; i++) {
+        SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, pixelFormat);
+        if (surface == nullptr) {
+            // all or nothing; ok() reports it and submit and nextFrame return at once
+            for (SDL_Surface *created : buffers) {
+                SDL_FreeSurface(created);
+            }
+            buffers.clear();
+            break;
+        }
+        buffers.push_back(surface);
+    }
+    freeBuffers = buffers;
+    thread = std::thread(&FramePipeline::renderLoop, this);
+}
+
+FramePipeline::~FramePipeline() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    thread.join();
+    for (SDL_Surface *surface : buffers) {
+        SDL_FreeSurface(surface);
+    }
+}
+
+void FramePipeline::submit(const Camera &camera, bool cameraMoved) {
+    if (buffers.empty()) {
+        return;
+    }
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [&] { return !freeBuffers.empty(); });
+    SDL_Surface *target = freeBuffers.back();
+    freeBuffers.pop_back();
+    requests.push_back({camera, cameraMoved, target});
+    changed.notify_all();
+}
+
+SDL_Surface *FramePipeline::nextFrame() {
+    if (buffers.empty()) {
+        return nullptr;
+    }
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [&] { return !finished.empty() || !freeBuffers.empty(); });
+    if (finished.empty()) {
+        return nullptr;
+    }
+    SDL_Surface *frame = finished.front();
+    finished.pop_front();
+    return frame;
+}
+
+void FramePipeline::release(SDL_Surface *frame) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        freeBuffers.push_back(frame);
+    }
+    changed.notify_all();
+}
+
+void FramePipeline::finish() {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [&] { return requests.empty() && !rendering; });
+    // frames rendered after the last nextFrame are never presented
+    freeBuffers.insert(freeBuffers.end(), finished.begin(), finished.end());
+    finished.clear();
+    changed.wait(guard, [&] { return freeBuffers.size() == buffers.size(); });
+}
+
+FrameInfo FramePipeline::lastFrameInfo() {
+    std::lock_guard<std::mutex> guard(lock);
+    return info;
+}
+
+void FramePipeline::renderLoop() {
+    PROFILE_THREAD_NAME("render");
+    while (true) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&] { return stopping || !requests.empty(); });
+            if (stopping) {
+                return;
+            }
+            request = requests.front();
+            requests.pop_front();
+            rendering = true;
+        }
+
+        // the latched camera; only this thread touches the globals while frames are in flight
+        applyCamera(request.camera);
+        bool drawn;
+        {
+            PROFILE_SCOPE("render");
+            drawn = renderer.renderFrame(request.target, request.cameraMoved);
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (drawn) {
+                finished.push_back(request.target);
+            } else {
+                // converged, the window already shows this image
+                freeBuffers.push_back(request.target);
+            }
+            info = {renderer.scale(), renderer.samples()};
+            rendering = false;
+        }
+        changed.notify_all();
+    }
+}
+
+FramePacer::FramePacer(double intervalMs)
+    : interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(intervalMs))),
+      next(std::chrono::steady_clock::now() + interval) {}
+
+void FramePacer::wait() {
+    auto now = std::chrono::steady_clock::now();
+    if (now < next) {
+        std::this_thread::sleep_until(next);
+        next += interval;
+    } else {
+        next = now + interval;
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "renderer.h"
+#include "interactive.h"
+
+// what the render thread reports about the last frame it finished
+struct FrameInfo {
+    float scale = 1.0f;
+    int samples = 0;
+};
+
+// Renders frames on a dedicated thread into a ring of offscreen surfaces in
+// the window's pixel format, so the render pool works on frame N+1 while the
+// main thread presents frame N. Each frame carries its own camera; the render
+// thread applies it just before drawing, so input never touches the camera
+// globals mid-frame.
+class FramePipeline {
+public:
+    // buffers: 2 for double buffering, 3 for triple
+    FramePipeline(InteractiveRenderer &renderer, Uint32 pixelFormat, int width, int height, int buffers);
+    ~FramePipeline();
+
+    // false if any buffer couldn't be created; SDL_GetError says why
+    bool ok() const { return !buffers.empty(); }
+
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    // queues a frame, waiting for a buffer if every one is in flight; does nothing unless ok()
+    void submit(const Camera &camera, bool cameraMoved);
+
+    // The oldest finished frame, or nullptr if none is ready. Waits only when
+    // every buffer is in flight, so the next submit has somewhere to render.
+    // Hand the frame back with release once it has been presented.
+    SDL_Surface *nextFrame();
+    void release(SDL_Surface *frame);
+
+    FrameInfo lastFrameInfo();
+
+    // Waits until the render thread is idle, drops finished frames nobody
+    // will present, then waits for the ones handed out to be released.
+    void finish();
+
+private:
+    struct Request {
+        Camera camera;
+        bool cameraMoved;
+        SDL_Surface *target;
+    };
+
+    void renderLoop();
+
+    InteractiveRenderer &renderer;
+    std::vector<SDL_Surface*> buffers;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<SDL_Surface*> freeBuffers;
+    std::deque<Request> requests;
+    std::deque<SDL_Surface*> finished;
+    FrameInfo info;
+    bool rendering = false; // the render thread holds a request
+    bool stopping = false;
+    std::thread thread;
+};
+
+// Sleeps out the rest of each frame interval. A frame that runs late starts a
+// new schedule rather than being followed by a burst of catch-up frames.
+class FramePacer {
+public:
+    explicit FramePacer(double intervalMs);
+    void wait();
+
+private:
+    std::chrono::steady_clock::duration interval;
+    std::chrono::steady_clock::time_point next;
+};
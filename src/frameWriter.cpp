@@ -0,0 +1,119 @@
+#include "frameWriter.h"
+#include "benchmark.h"
+#include "pixelPack.h"
+
+#include <chrono>
+
+FrameWriter::FrameWriter(FILE *out, FrameFormat format, int width, int height, int fps, int bufferCount)
+    : out(out), format(format), width(width), height(height), fps(fps) {
+    for (int i = 0; i < bufferCount; i++) {
+        SDL_Surface *surface = createOffscreenSurface(width, height);
+        if (surface != nullptr) {
+            buffers.push_back(surface);
+        }
+    }
+    freeBuffers = buffers;
+    // with no surfaces acquire would wait forever, so fail up front
+    failed = buffers.empty();
+    converted.resize((size_t)width * height * 3);
+    thread = std::thread(&FrameWriter::writeLoop, this);
+}
+
+FrameWriter::~FrameWriter() {
+    finish();
+    for (SDL_Surface *surface : buffers) {
+        SDL_FreeSurface(surface);
+    }
+}
+
+SDL_Surface *FrameWriter::acquire() {
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [&] { return failed || stopping || !freeBuffers.empty(); });
+    stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (failed || stopping) {
+        return nullptr;
+    }
+    SDL_Surface *frame = freeBuffers.back();
+    freeBuffers.pop_back();
+    return frame;
+}
+
+void FrameWriter::submit(SDL_Surface *frame) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        queued.push_back(frame);
+    }
+    changed.notify_all();
+}
+
+bool FrameWriter::finish() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+    bool ok = fflush(out) == 0;
+    return ok && !failed;
+}
+
+void FrameWriter::writeLoop() {
+    while (true) {
+        SDL_Surface *frame;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&] { return stopping || !queued.empty(); });
+            if (queued.empty()) {
+                return; // stopping, and everything submitted is written
+            }
+            frame = queued.front();
+            queued.pop_front();
+        }
+
+        bool ok = writeFrame(frame);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            freeBuffers.push_back(frame);
+            failed = failed || !ok;
+        }
+        changed.notify_all();
+    }
+}
+
+bool FrameWriter::writeFrame(SDL_Surface *frame) {
+    PixelLayout layout = pixelLayout(frame->format);
+    size_t planeSize = (size_t)width * height;
+    Uint8 *plane0 = converted.data();
+    Uint8 *plane1 = plane0 + planeSize;
+    Uint8 *plane2 = plane1 + planeSize;
+
+    for (int y = 0; y < height; y++) {
+        const Uint32 *row = (const Uint32*)((const Uint8*)frame->pixels + y * frame->pitch);
+        size_t i = (size_t)y * width;
+        for (int x = 0; x < width; x++, i++) {
+            int r = (row[x] >> layout.rShift) & 0xFF;
+            int g = (row[x] >> layout.gShift) & 0xFF;
+            int b = (row[x] >> layout.bShift) & 0xFF;
+            if (format == FRAME_RGB) {
+                plane0[i * 3] = r, plane0[i * 3 + 1] = g, plane0[i * 3 + 2] = b;
+            } else {
+                // BT.601 studio swing, integer form
+                plane0[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+                plane1[i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+                plane2[i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+            }
+        }
+    }
+
+    if (format == FRAME_Y4M) {
+        if (!headerWritten) {
+            fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height, fps);
+            headerWritten = true;
+        }
+        fputs("FRAME\n", out);
+    }
+    return fwrite(converted.data(), 1, converted.size(), out) == converted.size();
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <SDL2/SDL.h>
+
+enum FrameFormat {
+    FRAME_Y4M, // YUV4MPEG2, 4:4:4 BT.601 limited range
+    FRAME_RGB, // raw 8-bit RGB, no header
+};
+
+// Streams rendered frames to a file or pipe on its own thread, so the
+// renderer only waits on I/O when the writer falls a whole queue behind.
+// Frames live in a fixed ring of surfaces and are converted through buffers
+// sized to one frame, so memory does not grow with the sequence length.
+class FrameWriter {
+public:
+    // buffers: surfaces in the ring, at least 2; one is being rendered while
+    // the rest wait for or are being written
+    FrameWriter(FILE *out, FrameFormat format, int width, int height, int fps, int buffers);
+    ~FrameWriter();
+
+    FrameWriter(const FrameWriter&) = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+
+    // A free surface to render into, waiting while every one is queued.
+    // nullptr once a write has failed, after finish, or if no surface
+    // could be created.
+    SDL_Surface *acquire();
+    // queues a surface from acquire for writing, in submission order
+    void submit(SDL_Surface *frame);
+
+    // writes everything queued and stops the thread; false if any write failed
+    bool finish();
+
+    // time acquire spent waiting on the writer
+    double stallMs() const { return stallSeconds * 1000.0; }
+
+private:
+    void writeLoop();
+    bool writeFrame(SDL_Surface *frame);
+
+    FILE *out;
+    FrameFormat format;
+    int width, height, fps;
+    std::vector<SDL_Surface*> buffers;
+    std::vector<Uint8> converted; // one frame in the output layout
+    bool headerWritten = false;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<SDL_Surface*> freeBuffers;
+    std::deque<SDL_Surface*> queued;
+    bool stopping = false;
+    bool failed = false;
+    double stallSeconds = 0;
+    std::thread thread;
+};
@@ -0,0 +1,138 @@
+#include "interactive.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// upscale rows handed to each pool job
+constexpr int UPSCALE_BAND = 8;
+// resolution scale steps, so small frame time jitter does not resize every frame
+constexpr float SCALE_STEPS = 32.0f;
+
+InteractiveRenderer::InteractiveRenderer(const InteractiveConfig &config) : config(config) {}
+
+InteractiveRenderer::~InteractiveRenderer() {
+    if (lowRes != nullptr) {
+        SDL_FreeSurface(lowRes);
+    }
+}
+
+bool InteractiveRenderer::renderFrame(SDL_Surface *target, bool cameraMoved) {
+    if (cameraMoved) {
+        accum.samples = 0;
+        renderScaled(target);
+        return true;
+    }
+    if (accum.samples >= config.maxSamples) {
+        return false;
+    }
+    renderProgressive(target);
+    return true;
+}
+
+void InteractiveRenderer::renderScaled(SDL_Surface *target) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    int fullX = RES_X, fullY = RES_Y;
+    int lowX = std::max(1, (int)std::lround(fullX * resolutionScale));
+    int lowY = std::max(1, (int)std::lround(fullY * resolutionScale));
+    if (lowX >= fullX && lowY >= fullY) {
+        drawScene(target);
+    } else {
+        if (lowRes == nullptr || lowRes->w != lowX || lowRes->h != lowY || lowRes->format->format != target->format->format) {
+            if (lowRes != nullptr) {
+                SDL_FreeSurface(lowRes);
+            }
+            lowRes = SDL_CreateRGBSurfaceWithFormat(0, lowX, lowY, 32, target->format->format);
+        }
+        setResolution(lowX, lowY);
+        drawScene(lowRes);
+        setResolution(fullX, fullY);
+        upscaleSurface(lowRes, target);
+    }
+
+    // trace cost is roughly proportional to pixel count, so step the scale by
+    // the square root of the time ratio, damped so one slow frame is not an overreaction
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    float ideal = resolutionScale * (float)std::sqrt(config.targetFrameMs / std::max(ms, 0.1));
+    float next = resolutionScale + (ideal - resolutionScale) * 0.5f;
+    next = std::round(next * SCALE_STEPS) / SCALE_STEPS;
+    resolutionScale = std::clamp(next, config.minScale, 1.0f);
+}
+
+// sample 0 is the pixel centre, so the first converged frame matches a normal
+// render; the rest follow the R2 sequence, which covers the pixel evenly at any count
+Vec2 samplePosition(int sample) {
+    if (sample == 0) {
+        return {0.5f, 0.5f};
+    }
+    float x = 0.5f + sample * 0.7548776662f;
+    float y = 0.5f + sample * 0.5698402910f;
+    return {x - std::floor(x), y - std::floor(y)};
+}
+
+void InteractiveRenderer::renderProgressive(SDL_Surface *target) {
+    size_t pixels = (size_t)RES_X * RES_Y;
+    if (accum.samples == 0 || accum.sum.size() != pixels) {
+        accum.sum.assign(pixels, Vec3 {0, 0, 0});
+        accum.samples = 0;
+    }
+
+    pixelOffset = samplePosition(accum.samples);
+    accum.samples++;
+    drawScene(target, &accum);
+    pixelOffset = {0.5f, 0.5f};
+}
+
+// a + (b - a) * w / 256 on all four 8-bit channels at once
+inline Uint32 lerpPixel(Uint32 a, Uint32 b, Uint32 w) {
+    Uint32 rb = (((a & 0xFF00FF) * (256 - w) + (b & 0xFF00FF) * w) >> 8) & 0xFF00FF;
+    Uint32 ag = (((a >> 8) & 0xFF00FF) * (256 - w) + ((b >> 8) & 0xFF00FF) * w) & 0xFF00FF00;
+    return rb | ag;
+}
+
+struct SourceSpan {
+    int first;   // nearest source sample at or before the destination centre
+    int second;  // the one after it, clamped to the edge
+    Uint32 weight; // of second, 0-256
+};
+
+std::vector<SourceSpan> sourceSpans(int srcSize, int dstSize) {
+    std::vector<SourceSpan> spans(dstSize);
+    float step = (float)srcSize / dstSize;
+    for (int i = 0; i < dstSize; i++) {
+        float pos = std::clamp((i + 0.5f) * step - 0.5f, 0.0f, (float)(srcSize - 1));
+        int first = (int)pos;
+        spans[i] = {first, std::min(first + 1, srcSize - 1), (Uint32)((pos - first) * 256)};
+    }
+    return spans;
+}
+
+void upscaleSurface(SDL_Surface *src, SDL_Surface *dst) {
+    std::vector<SourceSpan> columns = sourceSpans(src->w, dst->w);
+    std::vector<SourceSpan> rows = sourceSpans(src->h, dst->h);
+
+    auto band = [&](int b) {
+        int endY = std::min((b + 1) * UPSCALE_BAND, dst->h);
+        for (int y = b * UPSCALE_BAND; y < endY; y++) {
+            const Uint32 *top = (const Uint32*)((const Uint8*)src->pixels + rows[y].first * src->pitch);
+            const Uint32 *bottom = (const Uint32*)((const Uint8*)src->pixels + rows[y].second * src->pitch);
+            Uint32 *out = (Uint32*)((Uint8*)dst->pixels + y * dst->pitch);
+            for (int x = 0; x < dst->w; x++) {
+                const SourceSpan &c = columns[x];
+                Uint32 upper = lerpPixel(top[c.first], top[c.second], c.weight);
+                Uint32 lower = lerpPixel(bottom[c.first], bottom[c.second], c.weight);
+                out[x] = lerpPixel(upper, lower, rows[y].weight);
+            }
+        }
+    };
+
+    int bands = (dst->h + UPSCALE_BAND - 1) / UPSCALE_BAND;
+    if (renderPool == nullptr) {
+        for (int b = 0; b < bands; b++) {
+            band(b);
+        }
+        return;
+    }
+    renderPool->parallelFor(bands, band);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "renderer.h"
+
+// Frame policy for the window. While the camera moves, frames are traced at a
+// reduced internal resolution sized to hit targetFrameMs and stretched to the
+// window. Once it stops, full-resolution samples at jittered pixel positions
+// are accumulated until maxSamples, converging to an antialiased image.
+struct InteractiveConfig {
+    float targetFrameMs = 16.0f;
+    float minScale = 0.25f;  // smallest internal resolution, as a fraction of the window
+    int maxSamples = 64;     // progressive samples per pixel before rendering stops
+};
+
+class InteractiveRenderer {
+public:
+    explicit InteractiveRenderer(const InteractiveConfig &config);
+    ~InteractiveRenderer();
+
+    // renders into target, which must be RES_X x RES_Y and 32 bits per pixel;
+    // returns false if nothing needed drawing (the image has converged)
+    bool renderFrame(SDL_Surface *target, bool cameraMoved);
+
+    float scale() const { return resolutionScale; }
+    int samples() const { return accum.samples; }
+
+private:
+    void renderScaled(SDL_Surface *target);
+    void renderProgressive(SDL_Surface *target);
+
+    InteractiveConfig config;
+    float resolutionScale = 1.0f;
+    SDL_Surface *lowRes = nullptr;
+    Accumulation accum;
+};
+
+// bilinear stretch between two 32-bit surfaces of the same pixel format
+void upscaleSurface(SDL_Surface *src, SDL_Surface *dst);
@@ -0,0 +1,41 @@
+#include "lightTree.h"
+
+#include <cmath>
+
+LightTree lightTree;
+
+float lightReach(const Light &light, float cutoff) {
+    float best = 2 * light.intensity;
+    if (best <= cutoff) {
+        return 0.0f;
+    }
+    if (light.range <= 0) {
+        return INFINITY;
+    }
+    // solve 2 * intensity * (1 - d^2 / range^2)^2 = cutoff for d
+    float falloff = cutoff > 0 ? std::sqrt(cutoff / best) : 0.0f;
+    return light.range * std::sqrt(1 - falloff);
+}
+
+void buildLightTree(const std::vector<int> &ranged, float cutoff) {
+    std::vector<AABB> bounds(ranged.size());
+    std::vector<float> reach(ranged.size());
+    for (size_t i = 0; i < ranged.size(); i++) {
+        const Light &light = lights[ranged[i]];
+        reach[i] = lightReach(light, cutoff);
+        Vec3 r = {reach[i], reach[i], reach[i]};
+        bounds[i] = {light.pos - r, light.pos + r};
+    }
+    lightTree.bvh = buildBVH(bounds);
+
+    int count = (int)ranged.size();
+    lightTree.lights.resize(count);
+    lightTree.pos.resize(count);
+    lightTree.reachSquared.resize(count);
+    for (int i = 0; i < count; i++) {
+        int source = lightTree.bvh.primIndices[i];
+        lightTree.lights[i] = ranged[source];
+        lightTree.pos[i] = lights[ranged[source]].pos;
+        lightTree.reachSquared[i] = reach[source] * reach[source];
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include "renderer.h"
+#include "bvh.h"
+
+// Point lights with a range, in a BVH over the spheres they can light. A
+// light's best case at distance d is full diffuse plus full specular,
+// 2 * intensity * (1 - d^2 / range^2)^2, so past the distance where that
+// drops to lightCutoff it can be skipped without looking at the surface.
+// gatherLights walks the tree for the lights reaching a shading point, so
+// the cost follows how many lights overlap there, not how many the scene has.
+
+struct LightTree {
+    BVH bvh;
+    // per leaf slot, in build order
+    std::vector<int> lights;         // lights[] index
+    std::vector<Vec3> pos;
+    std::vector<float> reachSquared;
+};
+
+extern LightTree lightTree;
+
+// how far a point light can add more than cutoff, 0 if nowhere; INFINITY without a range
+float lightReach(const Light &light, float cutoff);
+
+// rebuilds lightTree over the lights[] indices in ranged
+void buildLightTree(const std::vector<int> &ranged, float cutoff);
+
+// calls visit(lights[] index) for each tree light that reaches point
+template <typename Visit>
+void forLightsReaching(Vec3 point, Visit visit) {
+    const std::vector<BVHNode> &nodes = lightTree.bvh.nodes;
+    if (nodes.empty()) {
+        return;
+    }
+    const BVHNode *stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = &nodes[0];
+
+    while (stackSize > 0) {
+        const BVHNode *node = stack[--stackSize];
+        if (point.x < node->boundsMin.x || point.y < node->boundsMin.y || point.z < node->boundsMin.z ||
+            point.x > node->boundsMax.x || point.y > node->boundsMax.y || point.z > node->boundsMax.z) {
+            continue;
+        }
+        if (node->count > 0) {
+            for (int i = node->leftFirst; i < node->leftFirst + node->count; i++) {
+                Vec3 d = lightTree.pos[i] - point;
+                if (d.dot(d) < lightTree.reachSquared[i]) {
+                    visit(lightTree.lights[i]);
+                }
+            }
+        } else {
+            stack[stackSize++] = &nodes[node->leftFirst + 1];
+            stack[stackSize++] = &nodes[node->leftFirst];
+        }
+    }
+}
@@ -0,0 +1,207 @@
+#include "mesh.h"
+#include "profiler.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using std::cout, std::endl;
+
+std::vector<Mesh> meshes;
+
+// parses one face corner ("v", "v/t", "v/t/n" or "v//n") and returns the
+// zero-based vertex index, or -1 if it is malformed or out of range
+long parseFaceVertex(char *&p, long vertexCount) {
+    char *end;
+    long index = strtol(p, &end, 10);
+    if (end == p) {
+        return -1;
+    }
+    // texture and normal indices are not used
+    p = end;
+    while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+        p++;
+    }
+    index = index < 0 ? vertexCount + index : index - 1;
+    return index >= 0 && index < vertexCount ? index : -1;
+}
+
+bool loadOBJ(const std::string &path, Mesh &mesh) {
+    FILE *file = fopen(path.c_str(), "r");
+    if (!file) {
+        cout << "Error opening mesh " << path << endl;
+        return false;
+    }
+    static char readBuffer[1 << 16];
+    setvbuf(file, readBuffer, _IOFBF, sizeof(readBuffer));
+
+    mesh.vertices.clear();
+    mesh.indices.clear();
+
+    // getline grows the buffer, so long face records arrive whole
+    char *line = nullptr;
+    size_t lineCapacity = 0;
+    int lineNumber = 0;
+    bool ok = true;
+    while (ok && getline(&line, &lineCapacity, file) >= 0) {
+        lineNumber++;
+        char *p = line;
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            char *end;
+            float x = strtof(p + 2, &end);
+            float y = strtof(end, &end);
+            float z = strtof(end, &end);
+            mesh.vertices.push_back(x * mesh.scale + mesh.offset.x);
+            mesh.vertices.push_back(y * mesh.scale + mesh.offset.y);
+            mesh.vertices.push_back(z * mesh.scale + mesh.offset.z);
+        } else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            long vertexCount = (long)mesh.vertices.size() / 3;
+            long first = -1, previous = -1;
+            int corners = 0;
+            p += 2;
+            while (true) {
+                while (*p == ' ' || *p == '\t') {
+                    p++;
+                }
+                if (*p == '\0' || *p == '\r' || *p == '\n' || *p == '#') {
+                    break;
+                }
+                long index = parseFaceVertex(p, vertexCount);
+                if (index < 0) {
+                    ok = false;
+                    break;
+                }
+                if (corners == 0) {
+                    first = index;
+                } else if (corners >= 2) {
+                    mesh.indices.push_back((uint32_t)first);
+                    mesh.indices.push_back((uint32_t)previous);
+                    mesh.indices.push_back((uint32_t)index);
+                }
+                previous = index;
+                corners++;
+            }
+            ok = ok && corners >= 3;
+        }
+        // everything else (vt, vn, g, o, usemtl, ...) is ignored
+    }
+    free(line);
+    fclose(file);
+
+    if (!ok) {
+        cout << "Error in mesh " << path << " line " << lineNumber << endl;
+        return false;
+    }
+    if (mesh.indices.empty()) {
+        cout << "Error: " << path << " has no faces" << endl;
+        return false;
+    }
+    mesh.vertices.shrink_to_fit();
+    mesh.indices.shrink_to_fit();
+    mesh.path = path;
+    return true;
+}
+
+Vec3 meshVertex(const Mesh &mesh, uint32_t index) {
+    const float *v = &mesh.vertices[3 * (size_t)index];
+    return {v[0], v[1], v[2]};
+}
+
+void buildMeshAccel(Mesh &mesh) {
+    int count = (int)mesh.indices.size() / 3;
+    std::vector<AABB> bounds(count);
+    for (int i = 0; i < count; i++) {
+        for (int k = 0; k < 3; k++) {
+            bounds[i].grow(meshVertex(mesh, mesh.indices[3 * i + k]));
+        }
+    }
+    // one leaf fills one block, and the SAH knows a block costs one kernel call
+    mesh.bvh = buildBVH(bounds, TRI_BLOCK_SIZE, TRI_BLOCK_SIZE);
+
+    mesh.blocks.clear();
+    for (BVHNode &node : mesh.bvh.nodes) {
+        if (node.count == 0) {
+            continue;
+        }
+        int firstBlock = (int)mesh.blocks.size();
+        int blockCount = (node.count + TRI_BLOCK_SIZE - 1) / TRI_BLOCK_SIZE;
+        mesh.blocks.resize(firstBlock + blockCount, TriangleBlock {});
+        for (int i = 0; i < node.count; i++) {
+            int tri = mesh.bvh.primIndices[node.leftFirst + i];
+            Vec3 v0 = meshVertex(mesh, mesh.indices[3 * tri]);
+            Vec3 e1 = meshVertex(mesh, mesh.indices[3 * tri + 1]) - v0;
+            Vec3 e2 = meshVertex(mesh, mesh.indices[3 * tri + 2]) - v0;
+            TriangleBlock &block = mesh.blocks[firstBlock + i / TRI_BLOCK_SIZE];
+            int lane = i % TRI_BLOCK_SIZE;
+            block.v0x[lane] = v0.x, block.v0y[lane] = v0.y, block.v0z[lane] = v0.z;
+            block.e1x[lane] = e1.x, block.e1y[lane] = e1.y, block.e1z[lane] = e1.z;
+            block.e2x[lane] = e2.x, block.e2y[lane] = e2.y, block.e2z[lane] = e2.z;
+        }
+        node.leftFirst = firstBlock;
+    }
+    mesh.blocks.shrink_to_fit();
+
+    // rendering reads only the nodes and blocks
+    mesh.triangles = count;
+    std::vector<float>().swap(mesh.vertices);
+    std::vector<uint32_t>().swap(mesh.indices);
+    std::vector<int>().swap(mesh.bvh.primIndices);
+}
+
+inline int leafBlocks(const BVHNode &leaf) {
+    return (leaf.count + TRI_BLOCK_SIZE - 1) / TRI_BLOCK_SIZE;
+}
+
+bool closestMeshIntersection(Vec3 origin, Vec3 dir, HitRecord &hit) {
+    bool found = false;
+    for (int m = 0; m < (int)meshes.size(); m++) {
+        const Mesh &mesh = meshes[m];
+        bvhClosestHit(mesh.bvh.nodes, origin, dir, hit.t, [&](const BVHNode &leaf, float &tMax) {
+            for (int b = leaf.leftFirst; b < leaf.leftFirst + leafBlocks(leaf); b++) {
+                PROFILE_COUNT(triangleBlocks);
+                int lane = triangleKernel(mesh.blocks[b], origin, dir, tMax);
+                if (lane >= 0) {
+                    hit.primitive = b * TRI_BLOCK_SIZE + lane;
+                    hit.mesh = m;
+                    found = true;
+                }
+            }
+        });
+    }
+    return found;
+}
+
+bool blockOccludes(int mesh, int block, Vec3 origin, Vec3 dir, float tMax) {
+    PROFILE_COUNT(triangleBlocks);
+    return triangleKernel(meshes[mesh].blocks[block], origin, dir, tMax) >= 0;
+}
+
+bool meshOccludes(Vec3 origin, Vec3 dir, float tMax, Occluder &cache) {
+    for (int m = 0; m < (int)meshes.size(); m++) {
+        bool blocked = bvhAnyHit(meshes[m].bvh.nodes, origin, dir, tMax, [&](const BVHNode &leaf) {
+            for (int b = leaf.leftFirst; b < leaf.leftFirst + leafBlocks(leaf); b++) {
+                if (blockOccludes(m, b, origin, dir, tMax)) {
+                    cache = {b, m};
+                    return true;
+                }
+            }
+            return false;
+        });
+        if (blocked) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Vec3 meshHitNormal(const HitRecord &hit, Vec3 dir) {
+    const TriangleBlock &block = meshes[hit.mesh].blocks[hit.primitive / TRI_BLOCK_SIZE];
+    Vec3 normal = triangleNormal(block, hit.primitive % TRI_BLOCK_SIZE).normalized();
+    // OBJ winding is not reliable, so treat triangles as two-sided
+    return normal.dot(dir) > 0 ? normal * -1 : normal;
+}
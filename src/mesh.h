@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "renderer.h"
+#include "bvh.h"
+#include "triangle.h"
+
+// A triangle mesh with one material. vertices/indices are the flat buffers
+// the OBJ loader fills; buildMeshAccel regroups the triangles by BVH leaf
+// into blocks for the intersection kernel and frees them, so a loaded mesh
+// is only what rendering reads. Leaf nodes of bvh point at blocks[leftFirst]
+// and cover ceil(count / TRI_BLOCK_SIZE) blocks.
+struct Mesh {
+    std::vector<float> vertices;   // x, y, z per vertex, until buildMeshAccel
+    std::vector<uint32_t> indices; // three per triangle, until buildMeshAccel
+    BVH bvh;                       // nodes only once built
+    std::vector<TriangleBlock> blocks;
+    int triangles = 0;
+
+    Vec3 color = {200, 200, 200};
+    int specular = -1;
+    float reflectiveness = 0;
+
+    // where it came from, so scenes can be saved again
+    std::string path;
+    float scale = 1;
+    Vec3 offset = {0, 0, 0};
+
+    int triangleCount() const { return triangles; }
+};
+
+extern std::vector<Mesh> meshes;
+
+// Streams an OBJ file into mesh.vertices/indices, applying scale then offset.
+// Only v and f records are read; polygons are fan triangulated.
+bool loadOBJ(const std::string &path, Mesh &mesh);
+
+// builds bvh and blocks from vertices/indices, then frees vertices, indices
+// and bvh.primIndices
+void buildMeshAccel(Mesh &mesh);
+
+// nearest triangle over all meshes in (TMIN, hit.t); on a hit sets hit.t,
+// hit.mesh and hit.primitive and returns true
+bool closestMeshIntersection(Vec3 origin, Vec3 dir, HitRecord &hit);
+
+// true if any triangle lies in (TMIN, tMax); records the blocking block in cache
+bool meshOccludes(Vec3 origin, Vec3 dir, float tMax, Occluder &cache);
+
+// true if a triangle of meshes[mesh].blocks[block] lies in (TMIN, tMax)
+bool blockOccludes(int mesh, int block, Vec3 origin, Vec3 dir, float tMax);
+
+// unit geometric normal of a triangle hit, facing against dir
+Vec3 meshHitNormal(const HitRecord &hit, Vec3 dir);
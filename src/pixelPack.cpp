@@ -0,0 +1,39 @@
+#include "pixelPack.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__)
+#define PIXEL_PACK_X86
+#include <emmintrin.h>
+#endif
+
+PixelLayout pixelLayout(const SDL_PixelFormat *format) {
+    return {format->Rshift, format->Gshift, format->Bshift, format->Amask};
+}
+
+inline Uint32 packChannel(float c, int shift) {
+    return (Uint32)std::min(std::max(c, 0.0f), 255.0f) << shift;
+}
+
+void packRow(const float *r, const float *g, const float *b, int count, const PixelLayout &layout, Uint32 *out) {
+    int i = 0;
+#ifdef PIXEL_PACK_X86
+    const __m128 lo = _mm_setzero_ps();
+    const __m128 hi = _mm_set1_ps(255.0f);
+    const __m128i rShift = _mm_cvtsi32_si128(layout.rShift);
+    const __m128i gShift = _mm_cvtsi32_si128(layout.gShift);
+    const __m128i bShift = _mm_cvtsi32_si128(layout.bShift);
+    const __m128i alpha = _mm_set1_epi32((int)layout.alpha);
+    for (; i + 4 <= count; i += 4) {
+        __m128i ri = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(r + i), lo), hi));
+        __m128i gi = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(g + i), lo), hi));
+        __m128i bi = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(b + i), lo), hi));
+        __m128i pixel = _mm_or_si128(_mm_or_si128(_mm_sll_epi32(ri, rShift), _mm_sll_epi32(gi, gShift)),
+                                     _mm_or_si128(_mm_sll_epi32(bi, bShift), alpha));
+        _mm_storeu_si128((__m128i*)(out + i), pixel);
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = packChannel(r[i], layout.rShift) | packChannel(g[i], layout.gShift) | packChannel(b[i], layout.bShift) | layout.alpha;
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+
+// Where the 8-bit channels of a 32-bit surface format live.
+struct PixelLayout {
+    int rShift, gShift, bShift;
+    Uint32 alpha; // opaque alpha bits, 0 for formats without alpha
+};
+
+PixelLayout pixelLayout(const SDL_PixelFormat *format);
+
+// Clamps count colours to [0, 255], truncates them the way SDL_MapRGBA's Uint8
+// arguments do and packs them into out, four pixels per SSE2 instruction.
+void packRow(const float *r, const float *g, const float *b, int count, const PixelLayout &layout, Uint32 *out);
@@ -0,0 +1,199 @@
+#include "profiler.h"
+
+#ifdef RENDER_PROFILE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+thread_local ProfileCounters profileCounters;
+
+struct TraceEvent {
+    const char *name;
+    int64_t start;
+    int64_t duration;
+    int x, y;      // tile origin, -1 for stages
+    uint64_t rays;
+};
+
+struct ThreadTrace {
+    int id;
+    const char *name = nullptr;
+    std::vector<TraceEvent> events;
+};
+
+// per-stage time between stats lines
+struct StageTotal {
+    const char *name;
+    int64_t ns;
+    int count;
+};
+
+const auto profileEpoch = std::chrono::steady_clock::now();
+
+std::mutex traceLock; // guards threadTraces and stageTotals
+std::vector<std::unique_ptr<ThreadTrace>> threadTraces;
+std::vector<StageTotal> stageTotals;
+thread_local ThreadTrace *threadTrace = nullptr;
+
+std::atomic<bool> tracing{false};
+std::atomic<size_t> traceEventsLeft{0};
+
+std::atomic<uint64_t> totalSphereTests{0};
+std::atomic<uint64_t> totalTriangleBlocks{0};
+std::atomic<uint64_t> totalNodeCulls{0};
+std::atomic<uint64_t> totalShadowCacheHits{0};
+std::atomic<uint64_t> totalShadowCacheMisses{0};
+std::atomic<uint64_t> totalLightsCulled{0};
+std::atomic<uint64_t> tileCount{0};
+std::atomic<int64_t> tileNs{0};
+std::atomic<int64_t> slowestTileNs{0};
+
+int64_t profileNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profileEpoch).count();
+}
+
+ThreadTrace &currentThreadTrace() {
+    if (threadTrace == nullptr) {
+        std::lock_guard<std::mutex> guard(traceLock);
+        threadTraces.push_back(std::make_unique<ThreadTrace>());
+        threadTrace = threadTraces.back().get();
+        threadTrace->id = (int)threadTraces.size();
+    }
+    return *threadTrace;
+}
+
+void profileThreadName(const char *name) {
+    currentThreadTrace().name = name;
+}
+
+void recordEvent(const TraceEvent &event) {
+    if (!tracing.load(std::memory_order_relaxed)) {
+        return;
+    }
+    // claim a slot; once the budget is spent recording stops
+    size_t left = traceEventsLeft.load(std::memory_order_relaxed);
+    while (left > 0 && !traceEventsLeft.compare_exchange_weak(left, left - 1, std::memory_order_relaxed)) {
+    }
+    if (left > 0) {
+        currentThreadTrace().events.push_back(event);
+    }
+}
+
+void profileFlush() {
+    ProfileCounters &c = profileCounters;
+    totalSphereTests.fetch_add(c.sphereTests, std::memory_order_relaxed);
+    totalTriangleBlocks.fetch_add(c.triangleBlocks, std::memory_order_relaxed);
+    totalNodeCulls.fetch_add(c.nodeCulls, std::memory_order_relaxed);
+    totalShadowCacheHits.fetch_add(c.shadowCacheHits, std::memory_order_relaxed);
+    totalShadowCacheMisses.fetch_add(c.shadowCacheMisses, std::memory_order_relaxed);
+    totalLightsCulled.fetch_add(c.lightsCulled, std::memory_order_relaxed);
+    c = ProfileCounters {};
+}
+
+void profileTile(int x, int y, int64_t start, const RayCounts &rays) {
+    int64_t end = profileNow();
+    int64_t duration = end - start;
+    profileFlush();
+
+    tileCount.fetch_add(1, std::memory_order_relaxed);
+    tileNs.fetch_add(duration, std::memory_order_relaxed);
+    int64_t slowest = slowestTileNs.load(std::memory_order_relaxed);
+    while (duration > slowest && !slowestTileNs.compare_exchange_weak(slowest, duration, std::memory_order_relaxed)) {
+    }
+
+    recordEvent({"tile", start, duration, x, y, rays.primary + rays.shadow + rays.reflection});
+}
+
+void profileStage(const char *name, int64_t start) {
+    int64_t duration = profileNow() - start;
+    {
+        std::lock_guard<std::mutex> guard(traceLock);
+        auto it = std::find_if(stageTotals.begin(), stageTotals.end(), [&](const StageTotal &s) { return s.name == name; });
+        if (it == stageTotals.end()) {
+            stageTotals.push_back({name, duration, 1});
+        } else {
+            it->ns += duration;
+            it->count++;
+        }
+    }
+    recordEvent({name, start, duration, -1, -1, 0});
+}
+
+void profileStartTrace(size_t maxEvents) {
+    traceEventsLeft = maxEvents;
+    tracing = true;
+}
+
+bool writeChromeTrace(const std::string &path) {
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file) {
+        printf("Error opening %s for writing\n", path.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(traceLock);
+    fprintf(file, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (const std::unique_ptr<ThreadTrace> &thread : threadTraces) {
+        if (thread->name != nullptr) {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", thread->id, thread->name);
+            first = false;
+        }
+        for (const TraceEvent &e : thread->events) {
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                first ? "" : ",\n", e.name, thread->id, e.start / 1000.0, e.duration / 1000.0);
+            if (e.x >= 0) {
+                fprintf(file, ",\"args\":{\"x\":%d,\"y\":%d,\"rays\":%llu}", e.x, e.y, (unsigned long long)e.rays);
+            }
+            fprintf(file, "}");
+            first = false;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    bool ok = fclose(file) == 0;
+    if (!ok) {
+        printf("Error writing %s\n", path.c_str());
+    }
+    return ok;
+}
+
+std::string profileStatsLine(const RayCounts &rays) {
+    uint64_t hits = totalShadowCacheHits.exchange(0);
+    uint64_t misses = totalShadowCacheMisses.exchange(0);
+    uint64_t tiles = tileCount.exchange(0);
+    double meanTileMs = tiles > 0 ? tileNs.exchange(0) / 1e6 / tiles : 0.0;
+    double slowestTileMs = slowestTileNs.exchange(0) / 1e6;
+
+    char line[512];
+    int n = snprintf(line, sizeof(line),
+        "stats rays %llu/%llu/%llu sphere tests %llu triangle blocks %llu node culls %llu shadow cache %.1f%% lights culled %llu tiles %llu mean %.3f ms max %.3f ms",
+        (unsigned long long)rays.primary, (unsigned long long)rays.shadow, (unsigned long long)rays.reflection,
+        (unsigned long long)totalSphereTests.exchange(0), (unsigned long long)totalTriangleBlocks.exchange(0),
+        (unsigned long long)totalNodeCulls.exchange(0), hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0,
+        (unsigned long long)totalLightsCulled.exchange(0),
+        (unsigned long long)tiles, meanTileMs, slowestTileMs);
+
+    std::string result(line, std::min(n, (int)sizeof(line) - 1));
+    std::lock_guard<std::mutex> guard(traceLock);
+    for (StageTotal &stage : stageTotals) {
+        if (stage.count > 0) {
+            snprintf(line, sizeof(line), " %s %.3f ms", stage.name, stage.ns / 1e6 / stage.count);
+            result += line;
+        }
+        stage.ns = 0;
+        stage.count = 0;
+    }
+    return result;
+}
+
+void profileResetStats() {
+    profileStatsLine(RayCounts {});
+}
+
+#endif
@@ -0,0 +1,82 @@
+#pragma once
+
+// Hot-path instrumentation. Build with RENDER_PROFILE defined (cmake
+// -DRENDER_PROFILE=ON) to get per-thread counters, per-tile and per-stage
+// timing, a stats line and Chrome trace export (chrome://tracing or
+// ui.perfetto.dev). Without it every PROFILE_* macro expands to nothing and
+// none of this is compiled.
+//
+// Counters are plain thread_local integers, flushed into shared totals once
+// per tile by profileTile, the same way renderTile flushes ray counts. Work
+// outside renderTile flushes with PROFILE_FLUSH.
+
+#ifdef RENDER_PROFILE
+
+#include <cstdint>
+#include <string>
+#include "renderer.h"
+
+struct ProfileCounters {
+    uint64_t sphereTests = 0;     // ray/sphere pairs, scalar calls plus packet lanes
+    uint64_t triangleBlocks = 0;  // TRI_BLOCK_SIZE-wide triangle kernel calls
+    uint64_t nodeCulls = 0;       // BVH boxes a ray or packet missed
+    uint64_t shadowCacheHits = 0; // occluded() answered by the cached occluder
+    uint64_t shadowCacheMisses = 0;
+    uint64_t lightsCulled = 0;    // lights reaching a point that got no shadow ray
+};
+
+extern thread_local ProfileCounters profileCounters;
+
+int64_t profileNow(); // nanoseconds since startup
+
+// names the calling thread in the trace
+void profileThreadName(const char *name);
+
+// adds this thread's counters to the shared totals and clears them
+void profileFlush();
+// flushes this thread's counters and records a tile event
+void profileTile(int x, int y, int64_t start, const RayCounts &rays);
+
+// records a named span on this thread; the name must be a string literal
+void profileStage(const char *name, int64_t start);
+
+struct ProfileScope {
+    const char *name;
+    int64_t start;
+    explicit ProfileScope(const char *name) : name(name), start(profileNow()) {}
+    ~ProfileScope() { profileStage(name, start); }
+};
+
+// starts keeping trace events, up to maxEvents; write them out once no
+// frame is in flight
+void profileStartTrace(size_t maxEvents);
+bool writeChromeTrace(const std::string &path);
+
+// counters, the given ray counts and mean tile and stage times since the
+// previous call or reset
+std::string profileStatsLine(const RayCounts &rays);
+void profileResetStats();
+
+#define PROFILE_COUNT(counter) (profileCounters.counter++)
+#define PROFILE_ADD(counter, n) (profileCounters.counter += (n))
+#define PROFILE_TIMESTAMP(var) int64_t var = profileNow()
+#define PROFILE_TILE(x, y, start, rays) profileTile(x, y, start, rays)
+#define PROFILE_FLUSH() profileFlush()
+#define PROFILE_STAGE(name, start) profileStage(name, start)
+#define PROFILE_JOIN(a, b) a##b
+#define PROFILE_SCOPE_NAMED(name, line) ProfileScope PROFILE_JOIN(profileScope, line)(name)
+#define PROFILE_SCOPE(name) PROFILE_SCOPE_NAMED(name, __LINE__)
+#define PROFILE_THREAD_NAME(name) profileThreadName(name)
+
+#else
+
+#define PROFILE_COUNT(counter) ((void)0)
+#define PROFILE_ADD(counter, n) ((void)0)
+#define PROFILE_TIMESTAMP(var) ((void)0)
+#define PROFILE_TILE(x, y, start, rays) ((void)0)
+#define PROFILE_FLUSH() ((void)0)
+#define PROFILE_STAGE(name, start) ((void)0)
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_THREAD_NAME(name) ((void)0)
+
+#endif
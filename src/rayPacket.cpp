@@ -0,0 +1,248 @@
+#include "rayPacket.h"
+#include "triangle.h"
+#include "profiler.h"
+
+#if defined(__x86_64__)
+#define RAY_PACKET_X86
+#include <immintrin.h>
+#endif
+
+SphereSoA sphereSoA;
+
+SphereSoA buildSphereSoA(const Sphere *spheres, int numSpheres, std::vector<float> &storage) {
+    storage.resize(4 * (size_t)numSpheres);
+    float *x = storage.data();
+    float *y = x + numSpheres;
+    float *z = y + numSpheres;
+    float *rSquared = z + numSpheres;
+    for (int i = 0; i < numSpheres; i++) {
+        x[i] = spheres[i].origin.x;
+        y[i] = spheres[i].origin.y;
+        z[i] = spheres[i].origin.z;
+        rSquared[i] = spheres[i].rSquared;
+    }
+
+    SphereSoA soa;
+    soa.x = {x, numSpheres};
+    soa.y = {y, numSpheres};
+    soa.z = {z, numSpheres};
+    soa.rSquared = {rSquared, numSpheres};
+    soa.count = numSpheres;
+    return soa;
+}
+
+// All kernels use the half-b form of the quadratic: with co = origin - center,
+// b = co.d and c = co.co - r^2, the roots are (-b +- sqrt(b*b - a*c)) / a.
+// co and c are shared by every lane since the rays share an origin, so each
+// sphere costs one sqrt per packet and 1/a is hoisted out of the sphere loop.
+
+void closestHitScalar(const SphereSoA &soa, const RayPacket &packet, int first, int count, float *tOut, int *hitIndex) {
+    float a[PACKET_SIZE], invA[PACKET_SIZE];
+    for (int lane = 0; lane < PACKET_SIZE; lane++) {
+        a[lane] = packet.dx[lane] * packet.dx[lane] + packet.dy[lane] * packet.dy[lane] + packet.dz[lane] * packet.dz[lane];
+        invA[lane] = 1.0f / a[lane];
+    }
+
+    for (int i = first; i < first + count; i++) {
+        float cox = packet.origin.x - soa.x[i];
+        float coy = packet.origin.y - soa.y[i];
+        float coz = packet.origin.z - soa.z[i];
+        float c = cox * cox + coy * coy + coz * coz - soa.rSquared[i];
+        for (int lane = 0; lane < PACKET_SIZE; lane++) {
+            float b = cox * packet.dx[lane] + coy * packet.dy[lane] + coz * packet.dz[lane];
+            float discriminant = b * b - a[lane] * c;
+            if (discriminant < 0) {
+                continue;
+            }
+            float s = std::sqrt(discriminant);
+            float tNear = (-b - s) * invA[lane];
+            float t = tNear > TMIN ? tNear : (-b + s) * invA[lane];
+            if (t > TMIN && t < tOut[lane]) {
+                tOut[lane] = t;
+                hitIndex[lane] = i;
+            }
+        }
+    }
+}
+
+#ifdef RAY_PACKET_X86
+
+void closestHitSSE(const SphereSoA &soa, const RayPacket &packet, int first, int count, float *tOut, int *hitIndex) {
+    const __m128 tMin = _mm_set1_ps(TMIN);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (int base = 0; base < PACKET_SIZE; base += 4) {
+        __m128 dx = _mm_loadu_ps(packet.dx + base);
+        __m128 dy = _mm_loadu_ps(packet.dy + base);
+        __m128 dz = _mm_loadu_ps(packet.dz + base);
+        __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        __m128 invA = _mm_div_ps(_mm_set1_ps(1.0f), a);
+        __m128 closestT = _mm_loadu_ps(tOut + base);
+        __m128i closest = _mm_loadu_si128((const __m128i*)(hitIndex + base));
+
+        for (int i = first; i < first + count; i++) {
+            float cox = packet.origin.x - soa.x[i];
+            float coy = packet.origin.y - soa.y[i];
+            float coz = packet.origin.z - soa.z[i];
+            __m128 c = _mm_set1_ps(cox * cox + coy * coy + coz * coz - soa.rSquared[i]);
+
+            __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(cox), dx), _mm_mul_ps(_mm_set1_ps(coy), dy)), _mm_mul_ps(_mm_set1_ps(coz), dz));
+            __m128 discriminant = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(a, c));
+            __m128 real = _mm_cmpge_ps(discriminant, zero);
+            if (_mm_movemask_ps(real) == 0) {
+                continue;
+            }
+
+            __m128 s = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+            __m128 negB = _mm_sub_ps(zero, b);
+            __m128 tNear = _mm_mul_ps(_mm_sub_ps(negB, s), invA);
+            __m128 tFar = _mm_mul_ps(_mm_add_ps(negB, s), invA);
+            __m128 nearOk = _mm_cmpgt_ps(tNear, tMin);
+            __m128 t = _mm_or_ps(_mm_and_ps(nearOk, tNear), _mm_andnot_ps(nearOk, tFar));
+
+            __m128 hit = _mm_and_ps(real, _mm_and_ps(_mm_cmpgt_ps(t, tMin), _mm_cmplt_ps(t, closestT)));
+            closestT = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, closestT));
+            __m128i hitMask = _mm_castps_si128(hit);
+            closest = _mm_or_si128(_mm_and_si128(hitMask, _mm_set1_epi32(i)), _mm_andnot_si128(hitMask, closest));
+        }
+
+        _mm_storeu_ps(tOut + base, closestT);
+        _mm_storeu_si128((__m128i*)(hitIndex + base), closest);
+    }
+}
+
+__attribute__((target("avx2")))
+void closestHitAVX2(const SphereSoA &soa, const RayPacket &packet, int first, int count, float *tOut, int *hitIndex) {
+    static_assert(PACKET_SIZE == 8, "AVX2 kernel assumes one packet per register");
+    const __m256 tMin = _mm256_set1_ps(TMIN);
+    const __m256 zero = _mm256_setzero_ps();
+
+    __m256 dx = _mm256_loadu_ps(packet.dx);
+    __m256 dy = _mm256_loadu_ps(packet.dy);
+    __m256 dz = _mm256_loadu_ps(packet.dz);
+    __m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+    __m256 invA = _mm256_div_ps(_mm256_set1_ps(1.0f), a);
+    __m256 closestT = _mm256_loadu_ps(tOut);
+    __m256 closest = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)hitIndex));
+
+    for (int i = first; i < first + count; i++) {
+        float cox = packet.origin.x - soa.x[i];
+        float coy = packet.origin.y - soa.y[i];
+        float coz = packet.origin.z - soa.z[i];
+        __m256 c = _mm256_set1_ps(cox * cox + coy * coy + coz * coz - soa.rSquared[i]);
+
+        __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(cox), dx), _mm256_mul_ps(_mm256_set1_ps(coy), dy)), _mm256_mul_ps(_mm256_set1_ps(coz), dz));
+        __m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(a, c));
+        __m256 real = _mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ);
+        if (_mm256_movemask_ps(real) == 0) {
+            continue;
+        }
+
+        __m256 s = _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+        __m256 negB = _mm256_sub_ps(zero, b);
+        __m256 tNear = _mm256_mul_ps(_mm256_sub_ps(negB, s), invA);
+        __m256 tFar = _mm256_mul_ps(_mm256_add_ps(negB, s), invA);
+        __m256 t = _mm256_blendv_ps(tFar, tNear, _mm256_cmp_ps(tNear, tMin, _CMP_GT_OQ));
+
+        __m256 hit = _mm256_and_ps(real, _mm256_and_ps(_mm256_cmp_ps(t, tMin, _CMP_GT_OQ), _mm256_cmp_ps(t, closestT, _CMP_LT_OQ)));
+        closestT = _mm256_blendv_ps(closestT, t, hit);
+        closest = _mm256_blendv_ps(closest, _mm256_castsi256_ps(_mm256_set1_epi32(i)), hit);
+    }
+
+    _mm256_storeu_ps(tOut, closestT);
+    _mm256_storeu_si256((__m256i*)hitIndex, _mm256_castps_si256(closest));
+}
+
+#endif
+
+PacketKernel packetKernel = closestHitScalar;
+
+// entry distance of the nearest lane that can still improve on its hit, INFINITY if none
+float intersectPacketAABB(const RayPacket &packet, const float *invX, const float *invY, const float *invZ,
+                          const BVHNode &node, const float *tMax) {
+    float nearest = INFINITY;
+    for (int lane = 0; lane < PACKET_SIZE; lane++) {
+        Vec3 invDir = {invX[lane], invY[lane], invZ[lane]};
+        nearest = std::min(nearest, intersectAABB(packet.origin, invDir, node.boundsMin, node.boundsMax, tMax[lane]));
+    }
+    return nearest;
+}
+
+void closestHitPacket(BVHNodes nodes, const SphereSoA &soa, const RayPacket &packet, float tMax, float *tOut, int *hitIndex) {
+    for (int lane = 0; lane < PACKET_SIZE; lane++) {
+        tOut[lane] = tMax;
+        hitIndex[lane] = -1;
+    }
+    if (nodes.empty()) {
+        return;
+    }
+
+    float invX[PACKET_SIZE], invY[PACKET_SIZE], invZ[PACKET_SIZE];
+    for (int lane = 0; lane < PACKET_SIZE; lane++) {
+        invX[lane] = 1.0f / packet.dx[lane];
+        invY[lane] = 1.0f / packet.dy[lane];
+        invZ[lane] = 1.0f / packet.dz[lane];
+    }
+
+    // one traversal for the whole packet: a node is entered if any lane hits it
+    const BVHNode *stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = &nodes[0];
+    while (stackSize > 0) {
+        const BVHNode *node = stack[--stackSize];
+        if (intersectPacketAABB(packet, invX, invY, invZ, *node, tOut) == INFINITY) {
+            PROFILE_COUNT(nodeCulls);
+            continue;
+        }
+        if (node->count > 0) {
+            PROFILE_ADD(sphereTests, node->count * PACKET_SIZE);
+            packetKernel(soa, packet, node->leftFirst, node->count, tOut, hitIndex);
+            continue;
+        }
+
+        const BVHNode *near = &nodes[node->leftFirst];
+        const BVHNode *far = near + 1;
+        if (intersectPacketAABB(packet, invX, invY, invZ, *far, tOut) < intersectPacketAABB(packet, invX, invY, invZ, *near, tOut)) {
+            std::swap(near, far);
+        }
+        stack[stackSize++] = far;
+        stack[stackSize++] = near;
+    }
+}
+
+simdLevel detectSimdLevel() {
+#ifdef RAY_PACKET_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SIMD_AVX2;
+    }
+    return SIMD_SSE; // SSE2 is baseline on x86-64
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+simdLevel setSimdLevel(simdLevel level) {
+    simdLevel supported = detectSimdLevel();
+    if (level > supported) {
+        level = supported;
+    }
+
+    switch (level) {
+#ifdef RAY_PACKET_X86
+        case SIMD_AVX2: packetKernel = closestHitAVX2; break;
+        case SIMD_SSE: packetKernel = closestHitSSE; break;
+#endif
+        default: packetKernel = closestHitScalar; level = SIMD_SCALAR; break;
+    }
+    setTriangleKernel(level);
+    return level;
+}
+
+const char *simdLevelName(simdLevel level) {
+    switch (level) {
+        case SIMD_AVX2: return "avx2";
+        case SIMD_SSE: return "sse";
+        default: return "scalar";
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include "renderer.h"
+#include "bvh.h"
+
+// rays per packet; camera rays are traced PACKET_SIZE pixels at a time
+constexpr int PACKET_SIZE = 8;
+
+enum simdLevel {
+    SIMD_SCALAR, SIMD_SSE, SIMD_AVX2
+};
+
+// geometry-only copy of the spheres, one array per field
+struct SphereSoA {
+    ArrayView<const float> x, y, z, rSquared;
+    int count = 0;
+};
+
+// rays sharing one origin, directions stored per lane
+struct RayPacket {
+    Vec3 origin;
+    float dx[PACKET_SIZE];
+    float dy[PACKET_SIZE];
+    float dz[PACKET_SIZE];
+};
+
+// tests spheres [first, first + count) against every lane, lowering tOut and
+// setting hitIndex where a lane finds a closer hit in (TMIN, tOut)
+typedef void (*PacketKernel)(const SphereSoA &soa, const RayPacket &packet, int first, int count, float *tOut, int *hitIndex);
+
+extern SphereSoA sphereSoA;
+extern PacketKernel packetKernel;
+
+// closest hit per lane through the BVH, hitIndex is -1 on a miss
+void closestHitPacket(BVHNodes nodes, const SphereSoA &soa, const RayPacket &packet, float tMax, float *tOut, int *hitIndex);
+
+// storage receives the four arrays back to back and must outlive the result
+SphereSoA buildSphereSoA(const Sphere *spheres, int numSpheres, std::vector<float> &storage);
+
+simdLevel detectSimdLevel();
+// picks the packet kernel, clamped to what this CPU supports; returns the level in use
+simdLevel setSimdLevel(simdLevel level);
+const char *simdLevelName(simdLevel level);
@@ -0,0 +1,625 @@
+#include "renderer.h"
+#include "rayPacket.h"
+#include "bvh.h"
+#include "mesh.h"
+#include "wavefront.h"
+#include "tileScheduler.h"
+#include "antialias.h"
+#include "pixelPack.h"
+#include "profiler.h"
+#include "lightTree.h"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+thread_local RayCounts tileRays;
+thread_local RowColors rowColors;
+
+// per light: whatever last blocked it on this thread, tried before traversal
+thread_local std::vector<Occluder> lightOccluders;
+// computeLighting's gathered lights, reused from point to point
+thread_local std::vector<LightSample> lightSamples;
+
+std::atomic<uint64_t> totalPrimaryRays{0};
+std::atomic<uint64_t> totalShadowRays{0};
+std::atomic<uint64_t> totalReflectionRays{0};
+
+std::vector<Sphere> sceneSpheres = {
+    {{0, -1, 3}, {255, 0, 0}, 1, 0.2f, 500, 1},         // red, shiny, bit reflective
+    {{2, 0, 4}, {0, 0, 255}, 1, 0.3f, 500, 1},          // blue, shiny, bit more reflective
+    {{-2, 0, 4}, {0, 255, 0}, 1, 0.4f, 10, 1},          // green, somewhat shiny, more reflective
+    {{0, -5001, 0}, {255, 255, 0}, 5000, 0.5f, 1000, static_cast<float>(pow(5000, 2))} // yellow, very Shiny, half reflective
+};
+
+std::vector<Light> sceneLights = {{AMBIENT, 0.2, {0, 0, 0}, 0}, {POINT, 0.6, {2, 1, 0}, 0}, {DIRECTIONAL, 0.2, {1, 4, 4}, 0}};
+
+// backing store for the views when the scene is built in memory
+BVH sphereBVH;
+std::vector<float> sphereSoAStorage;
+
+ArrayView<const Sphere> spheres;
+ArrayView<const Light> lights;
+BVHNodes sphereNodes;
+
+int RES_X = 500;
+int RES_Y = 500;
+
+int INF = 16777215;
+float TMIN = 0.05f;
+
+int reflectRecursion = 3;
+
+float distance = 1.0f;
+
+int FOV = 53;
+
+float aspectRatio = (float)RES_X / RES_Y;
+float fovScale = tanf(FOV * 0.5f * M_PI / 180.0f); // if FOV in degrees
+float aspectTimesFovScale = aspectRatio * fovScale;
+
+Vec3 cameraPos = {0, 0, 0};
+Vec3 cameraForward = {0, 0, 1};
+Vec3 cameraUp = {0, 1, 0};
+Vec3 cameraRight = {1, 0, 0};
+
+Vec2 pixelOffset = {0.5f, 0.5f};
+
+// about half an 8-bit step on a white surface
+float lightCutoff = 0.002f;
+// lightGroups and lightTree are stale
+bool lightsDirty = true;
+
+void setResolution(int resX, int resY) {
+    RES_X = resX;
+    RES_Y = resY;
+    aspectRatio = (float)RES_X / RES_Y;
+    aspectTimesFovScale = aspectRatio * fovScale;
+}
+
+void setFov(int fov) {
+    FOV = fov;
+    fovScale = tanf(FOV * 0.5f * M_PI / 180.0f);
+    aspectTimesFovScale = aspectRatio * fovScale;
+}
+
+void setLightCutoff(float cutoff) {
+    if (cutoff != lightCutoff) {
+        lightCutoff = cutoff;
+        lightsDirty = true;
+    }
+}
+
+void invalidateLights() {
+    lightsDirty = true;
+}
+
+void resetCamera() {
+    cameraPos = {0, 0, 0};
+    cameraForward = {0, 0, 1};
+    cameraUp = {0, 1, 0};
+    cameraRight = {1, 0, 0};
+}
+
+Camera cameraState() {
+    return {cameraPos, cameraForward, cameraUp, cameraRight};
+}
+
+void applyCamera(const Camera &camera) {
+    cameraPos = camera.pos;
+    cameraForward = camera.forward;
+    cameraUp = camera.up;
+    cameraRight = camera.right;
+}
+
+Vec3 rotateAroundAxis(const Vec3& vec, const Vec3& axis, float angle) {
+    Vec3 k = axis.normalized();
+    float cosTheta = std::cos(angle);
+    float sinTheta = std::sin(angle);
+    Vec3 vCrossK = k.cross(vec);
+    float kDotV = k.dot(vec);
+
+    return {
+        vec.x * cosTheta + vCrossK.x * sinTheta + k.x * kDotV * (1 - cosTheta),
+        vec.y * cosTheta + vCrossK.y * sinTheta + k.y * kDotV * (1 - cosTheta),
+        vec.z * cosTheta + vCrossK.z * sinTheta + k.z * kDotV * (1 - cosTheta)
+    };
+}
+
+Vec3 cameraRayDir(float px, float py) {
+    float u = (px / RES_X * 2 - 1) * aspectTimesFovScale;
+    float v = (1 - py / RES_Y * 2) * fovScale;
+
+    return (cameraForward + cameraRight * u + cameraUp * v).normalized();
+}
+
+Vec3 canvasToViewport(int x, int y) {
+    return cameraRayDir(x + pixelOffset.x, y + pixelOffset.y);
+}
+
+Vec3 reflectRay(Vec3 ray, Vec3 normal) {
+    return normal * normal.dot(ray) * 2 - ray;
+}
+
+Vec2 intersectRaySphere(Vec3 origin, Vec3 dir, float dotDir, const Sphere &sphere) {
+    PROFILE_COUNT(sphereTests);
+    Vec3 co = origin - sphere.origin;
+
+    // half-b form, one sqrt and one divide
+    float a = dotDir;
+    float b = co.dot(dir);
+    float c = co.dot(co) - sphere.rSquared;
+
+    float discriminant = b*b - a*c;
+    if (discriminant < 0) {
+        return Vec2 {(float)INF, (float)INF};
+    }
+
+    float s = std::sqrt(discriminant);
+    float invA = 1.0f / a;
+    float t1 = (-b + s) * invA;
+    float t2 = (-b - s) * invA;
+
+    return Vec2 {t1, t2};
+}
+
+void buildSceneAccel() {
+    std::vector<AABB> bounds(sceneSpheres.size());
+    for (size_t i = 0; i < sceneSpheres.size(); i++) {
+        Vec3 r = {sceneSpheres[i].radius, sceneSpheres[i].radius, sceneSpheres[i].radius};
+        bounds[i] = {sceneSpheres[i].origin - r, sceneSpheres[i].origin + r};
+    }
+    sphereBVH = buildBVH(bounds);
+
+    // store spheres in leaf order so a leaf is a contiguous run of spheres[] and sphereSoA
+    std::vector<Sphere> ordered(sceneSpheres.size());
+    for (size_t i = 0; i < sceneSpheres.size(); i++) {
+        ordered[i] = sceneSpheres[sphereBVH.primIndices[i]];
+        sphereBVH.primIndices[i] = (int)i;
+    }
+    sceneSpheres.swap(ordered);
+
+    spheres = sceneSpheres;
+    lights = sceneLights;
+    invalidateLights();
+    sphereNodes = sphereBVH.nodes;
+    sphereSoA = buildSphereSoA(sceneSpheres.data(), (int)sceneSpheres.size(), sphereSoAStorage);
+}
+
+void setHitNormal(Vec3 origin, Vec3 dir, HitRecord &hit) {
+    if (hit.mesh >= 0) {
+        hit.normal = meshHitNormal(hit, dir);
+    } else {
+        hit.normal = (origin + dir * hit.t - spheres[hit.primitive].origin).normalized();
+    }
+}
+
+HitRecord closestIntersection(Vec3 origin, Vec3 dir, float tMax) {
+    HitRecord hit;
+    hit.t = tMax;
+    float dotDir = dir.dot(dir);
+
+    bvhClosestHit(sphereNodes, origin, dir, hit.t, [&](const BVHNode &leaf, float &tMax) {
+        for (int i = leaf.leftFirst; i < leaf.leftFirst + leaf.count; i++) {
+            Vec2 t = intersectRaySphere(origin, dir, dotDir, spheres[i]);
+            if (t.x > TMIN && t.x < tMax) {
+                tMax = t.x;
+                hit.primitive = i;
+            }
+            if (t.y > TMIN && t.y < tMax) {
+                tMax = t.y;
+                hit.primitive = i;
+            }
+        }
+    });
+    closestMeshIntersection(origin, dir, hit);
+
+    if (hit.primitive >= 0) {
+        setHitNormal(origin, dir, hit);
+    }
+    return hit;
+}
+
+bool blocksRay(Vec3 origin, Vec3 dir, float dotDir, float tMax, const Sphere &sphere) {
+    Vec2 t = intersectRaySphere(origin, dir, dotDir, sphere);
+    return (t.x > TMIN && t.x < tMax) || (t.y > TMIN && t.y < tMax);
+}
+
+bool occluded(Vec3 origin, Vec3 dir, float tMax, Occluder &cache) {
+    float dotDir = dir.dot(dir);
+    tileRays.shadow++;
+
+    // neighbouring shading points tend to share an occluder, try it first
+    if (cache.primitive >= 0) {
+        bool blocked = cache.mesh >= 0 ? blockOccludes(cache.mesh, cache.primitive, origin, dir, tMax)
+                                       : blocksRay(origin, dir, dotDir, tMax, spheres[cache.primitive]);
+        if (blocked) {
+            PROFILE_COUNT(shadowCacheHits);
+            return true;
+        }
+    }
+    PROFILE_COUNT(shadowCacheMisses);
+
+    bool blocked = bvhAnyHit(sphereNodes, origin, dir, tMax, [&](const BVHNode &leaf) {
+        for (int i = leaf.leftFirst; i < leaf.leftFirst + leaf.count; i++) {
+            if (blocksRay(origin, dir, dotDir, tMax, spheres[i])) {
+                cache = {i, -1};
+                return true;
+            }
+        }
+        return false;
+    });
+    if (blocked || meshOccludes(origin, dir, tMax, cache)) {
+        return true;
+    }
+    cache = {};
+    return false;
+}
+
+std::vector<Occluder> &threadLightOccluders() {
+    if (lightOccluders.size() != (size_t)lights.size()) {
+        // first use on this thread, or the scene changed
+        lightOccluders.assign(lights.size(), Occluder {});
+    }
+    return lightOccluders;
+}
+
+// x^n by squaring; specular exponents are integers, often in the hundreds
+inline float powInt(float x, int n) {
+    float result = 1.0f;
+    while (n > 0) {
+        if (n & 1) {
+            result *= x;
+        }
+        x *= x;
+        n >>= 1;
+    }
+    return result;
+}
+
+// one light's unshadowed diffuse and specular at point, appended if it clears lightCutoff
+template <lightType Type>
+void gatherLight(int index, Vec3 point, Vec3 normal, Vec3 view, int specular, std::vector<LightSample> &samples) {
+    const Light &light = lights[index];
+    float tMax;
+    Vec3 L = lightVector<Type>(light, point, tMax);
+
+    // behind the surface there is no diffuse, and the surface itself is in the way
+    float n = normal.dot(L);
+    if (n <= 0) {
+        PROFILE_COUNT(lightsCulled);
+        return;
+    }
+    float lengthSquared = L.dot(L);
+    float falloff = 1.0f;
+    if (Type == POINT && light.range > 0) {
+        float w = 1 - lengthSquared / (light.range * light.range);
+        if (w <= 0) {
+            PROFILE_COUNT(lightsCulled);
+            return;
+        }
+        falloff = w * w;
+    }
+    float invLength = 1.0f / std::sqrt(lengthSquared);
+
+    // Diffuse
+    float contribution = light.intensity * n * invLength;
+
+    // Specular; reflecting L about a unit normal keeps its length
+    if (specular != -1) {
+        Vec3 R = normal * n * 2 - L;
+        float rv = R.dot(view);
+        if (rv > 0) {
+            contribution += light.intensity * powInt(rv * invLength, specular);
+        }
+    }
+
+    contribution *= falloff;
+    if (contribution <= lightCutoff) {
+        PROFILE_COUNT(lightsCulled);
+        return;
+    }
+    samples.push_back({index, L, tMax, contribution});
+}
+
+void gatherLights(Vec3 point, Vec3 normal, Vec3 view, int specular, std::vector<LightSample> &samples) {
+    for (int i : lightGroups.point) {
+        gatherLight<POINT>(i, point, normal, view, specular, samples);
+    }
+    forLightsReaching(point, [&](int i) { gatherLight<POINT>(i, point, normal, view, specular, samples); });
+    for (int i : lightGroups.directional) {
+        gatherLight<DIRECTIONAL>(i, point, normal, view, specular, samples);
+    }
+}
+
+float computeLighting(Vec3 point, Vec3 normal, Vec3 view, int specular) {
+    std::vector<Occluder> &occluders = threadLightOccluders();
+    std::vector<LightSample> &samples = lightSamples;
+    samples.clear();
+    gatherLights(point, normal, view, specular, samples);
+
+    float intensity = lightGroups.ambient;
+    for (const LightSample &sample : samples) {
+        // Shadow check
+        if (!occluded(point, sample.L, sample.tMax, occluders[sample.light])) {
+            intensity += sample.contribution;
+        }
+    }
+    return intensity;
+}
+
+Material hitMaterial(const HitRecord &hit) {
+    if (hit.mesh >= 0) {
+        const Mesh &mesh = meshes[hit.mesh];
+        return {mesh.color, mesh.specular, mesh.reflectiveness};
+    }
+    const Sphere &sphere = spheres[hit.primitive];
+    return {sphere.color, sphere.specular, sphere.reflectiveness};
+}
+
+// Local colour plus reflection for one hit. reflected(P, R) shades the
+// reflected ray, so the depth-specialised and runtime-depth paths share this.
+template <bool Reflects, typename Reflected>
+inline Vec3 shadeWith(Vec3 origin, Vec3 dir, const HitRecord &hit, Reflected reflected) {
+    Material material = hitMaterial(hit);
+
+    // Compute local color
+    Vec3 P = origin + dir * hit.t;
+    Vec3 view = (dir * -1).normalized();
+    Vec3 localColor = material.color * computeLighting(P, hit.normal, view, material.specular);
+
+    // if we hit the recursion limit or the object is not reflective, we're done
+    float r = material.reflectiveness;
+    if (!Reflects || r <= 0) {
+        return localColor;
+    }
+
+    // compute the reflected color
+    Vec3 R = reflectRay(dir * -1, hit.normal);
+    tileRays.reflection++;
+    Vec3 reflectedColor = reflected(P, R);
+
+    return localColor * (1 - r) + reflectedColor * r;
+}
+
+// depth as a template parameter, so the recursion unrolls at compile time
+template <int Depth>
+Vec3 shadeHitDepth(Vec3 origin, Vec3 dir, const HitRecord &hit) {
+    return shadeWith<(Depth > 0)>(origin, dir, hit, [](Vec3 P, Vec3 R) -> Vec3 {
+        if constexpr (Depth > 0) {
+            HitRecord next = closestIntersection(P, R, (float)INF);
+            return next.primitive < 0 ? Vec3 BACKGROUND_COLOR : shadeHitDepth<Depth - 1>(P, R, next);
+        } else {
+            return BACKGROUND_COLOR;
+        }
+    });
+}
+
+// depths with a specialised kernel; deeper ones recurse at runtime down to it
+const int MAX_SPECIALIZED_DEPTH = 8;
+using ShadeKernel = Vec3 (*)(Vec3 origin, Vec3 dir, const HitRecord &hit);
+
+template <int... Depths>
+constexpr std::array<ShadeKernel, sizeof...(Depths)> shadeKernelTable(std::integer_sequence<int, Depths...>) {
+    return {shadeHitDepth<Depths>...};
+}
+const std::array<ShadeKernel, MAX_SPECIALIZED_DEPTH + 1> shadeKernels =
+    shadeKernelTable(std::make_integer_sequence<int, MAX_SPECIALIZED_DEPTH + 1>());
+
+// picked by prepareShading for reflectRecursion, read by the tile executors
+ShadeKernel primaryShade = shadeHitDepth<0>;
+LightGroups lightGroups;
+
+void groupLights() {
+    lightGroups = LightGroups {};
+    for (int i = 0; i < lights.size(); i++) {
+        const Light &light = lights[i];
+        if (light.type == AMBIENT) {
+            lightGroups.ambient += light.intensity;
+            continue;
+        }
+        float reach = lightReach(light, lightCutoff);
+        if (reach <= 0) {
+            continue;
+        }
+        if (light.type == DIRECTIONAL) {
+            lightGroups.directional.push_back(i);
+        } else {
+            (reach == INFINITY ? lightGroups.point : lightGroups.ranged).push_back(i);
+        }
+    }
+    buildLightTree(lightGroups.ranged, lightCutoff);
+}
+
+void prepareShading() {
+    // lights only change on load or with the cutoff, not from frame to frame
+    if (lightsDirty) {
+        groupLights();
+        lightsDirty = false;
+    }
+    primaryShade = reflectRecursion <= MAX_SPECIALIZED_DEPTH ? shadeKernels[std::max(reflectRecursion, 0)] : nullptr;
+}
+
+Vec3 traceRay(Vec3 origin, Vec3 dir, int recursionDepth) {
+    HitRecord hit = closestIntersection(origin, dir, (float)INF);
+
+    if (hit.primitive < 0) {
+        return BACKGROUND_COLOR;
+    }
+
+    return shadeHit(origin, dir, hit, recursionDepth);
+}
+
+Vec3 shadeHit(Vec3 origin, Vec3 dir, const HitRecord &hit, int recursionDepth) {
+    if (recursionDepth <= MAX_SPECIALIZED_DEPTH) {
+        return shadeKernels[std::max(recursionDepth, 0)](origin, dir, hit);
+    }
+    return shadeWith<true>(origin, dir, hit, [&](Vec3 P, Vec3 R) { return traceRay(P, R, recursionDepth - 1); });
+}
+
+int tracePrimaryPacket(int x, int y, int endX, Vec3 *dirs, HitRecord *hits) {
+    // camera rays are coherent, so intersect them PACKET_SIZE at a time
+    RayPacket packet;
+    packet.origin = cameraPos;
+    float t[PACKET_SIZE];
+    int hit[PACKET_SIZE];
+
+    int count = std::min(PACKET_SIZE, endX - x);
+    for (int lane = 0; lane < PACKET_SIZE; lane++) {
+        // spare lanes repeat the last pixel and are ignored
+        Vec3 rayDir = canvasToViewport(x + std::min(lane, count - 1), y);
+        packet.dx[lane] = rayDir.x;
+        packet.dy[lane] = rayDir.y;
+        packet.dz[lane] = rayDir.z;
+    }
+    closestHitPacket(sphereNodes, sphereSoA, packet, (float)INF, t, hit);
+    tileRays.primary += count;
+
+    for (int lane = 0; lane < count; lane++) {
+        dirs[lane] = {packet.dx[lane], packet.dy[lane], packet.dz[lane]};
+        HitRecord &laneHit = hits[lane];
+        laneHit = HitRecord {};
+        laneHit.t = hit[lane] >= 0 ? t[lane] : (float)INF;
+        laneHit.primitive = hit[lane];
+        closestMeshIntersection(cameraPos, dirs[lane], laneHit);
+        if (laneHit.primitive >= 0) {
+            setHitNormal(cameraPos, dirs[lane], laneHit);
+        }
+    }
+
+    if (edgeCapture != nullptr) {
+        for (int lane = 0; lane < count; lane++) {
+            const HitRecord &laneHit = hits[lane];
+            int pixel = y * RES_X + x + lane;
+            edgeCapture->object[pixel] = laneHit.primitive < 0 ? -1 : laneHit.mesh >= 0 ? (int)spheres.size() + laneHit.mesh : laneHit.primitive;
+            edgeCapture->normal[pixel] = laneHit.primitive < 0 ? Vec3 {0, 0, 0} : laneHit.normal;
+        }
+    }
+    return count;
+}
+
+RowColors &threadRowColors(int width) {
+    if ((int)rowColors.r.size() < width) {
+        rowColors.r.resize(width);
+        rowColors.g.resize(width);
+        rowColors.b.resize(width);
+    }
+    return rowColors;
+}
+
+void storeRow(SDL_Surface *surface, int x, int y, int count, RowColors &row, Accumulation *accum) {
+    if (accum != nullptr) {
+        Vec3 *sum = &accum->sum[y * RES_X + x];
+        float scale = 1.0f / accum->samples;
+        for (int i = 0; i < count; i++) {
+            sum[i] = sum[i] + Vec3 {std::min(row.r[i], 255.0f), std::min(row.g[i], 255.0f), std::min(row.b[i], 255.0f)};
+            Vec3 mean = sum[i] * scale;
+            row.r[i] = mean.x, row.g[i] = mean.y, row.b[i] = mean.z;
+        }
+    }
+    if (edgeCapture != nullptr) {
+        Vec3 *color = &edgeCapture->color[y * RES_X + x];
+        for (int i = 0; i < count; i++) {
+            color[i] = {std::min(row.r[i], 255.0f), std::min(row.g[i], 255.0f), std::min(row.b[i], 255.0f)};
+        }
+    }
+    Uint32 *pixels = (Uint32*)((Uint8*)surface->pixels + y * surface->pitch) + x;
+    packRow(row.r.data(), row.g.data(), row.b.data(), count, pixelLayout(surface->format), pixels);
+}
+
+void traceTileRecursive(SDL_Surface *surface, int startX, int startY, int endX, int endY, Accumulation *accum) {
+    Vec3 dirs[PACKET_SIZE];
+    HitRecord hits[PACKET_SIZE];
+    RowColors &row = threadRowColors(endX - startX);
+    for (int y = startY; y < endY; y++) {
+        for (int x = startX; x < endX; x += PACKET_SIZE) {
+            int count = tracePrimaryPacket(x, y, endX, dirs, hits);
+            for (int lane = 0; lane < count; lane++) {
+                Vec3 color = BACKGROUND_COLOR;
+                if (hits[lane].primitive >= 0) {
+                    color = primaryShade != nullptr ? primaryShade(cameraPos, dirs[lane], hits[lane])
+                                                    : shadeHit(cameraPos, dirs[lane], hits[lane], reflectRecursion);
+                }
+                int i = x + lane - startX;
+                row.r[i] = color.x, row.g[i] = color.y, row.b[i] = color.z;
+            }
+        }
+        storeRow(surface, startX, y, endX - startX, row, accum);
+    }
+}
+
+void renderTile(SDL_Surface *surface, int startX, int startY, int tileSize, Accumulation *accum) {
+    PROFILE_TIMESTAMP(tileStart);
+    tileRays = RayCounts{};
+    int endX = std::min(startX + tileSize, RES_X);
+    int endY = std::min(startY + tileSize, RES_Y);
+
+    if (useWavefront) {
+        traceTileWavefront(surface, startX, startY, endX, endY, accum);
+    } else {
+        traceTileRecursive(surface, startX, startY, endX, endY, accum);
+    }
+
+    PROFILE_TILE(startX, startY, tileStart, tileRays);
+    flushTileRays();
+}
+
+void flushTileRays() {
+    totalPrimaryRays += tileRays.primary;
+    totalShadowRays += tileRays.shadow;
+    totalReflectionRays += tileRays.reflection;
+    tileRays = RayCounts{};
+}
+
+RayCounts rayTotals() {
+    return {totalPrimaryRays.load(), totalShadowRays.load(), totalReflectionRays.load()};
+}
+
+void resetRayTotals() {
+    totalPrimaryRays = 0;
+    totalShadowRays = 0;
+    totalReflectionRays = 0;
+}
+
+
+int TILE = 32;
+bool useWavefront = false;
+bool adaptiveTiles = false;
+
+ThreadPool *renderPool = nullptr;
+
+
+
+void drawTiles(SDL_Surface *surface, Accumulation *accum) {
+    int tilesX = (RES_X + TILE - 1) / TILE;
+    int tileCount = tilesX * ((RES_Y + TILE - 1) / TILE);
+    auto tile = [&](int t) {
+        renderTile(surface, (t % tilesX) * TILE, (t / tilesX) * TILE, TILE, accum);
+    };
+
+    if (renderPool == nullptr) {
+        for (int t = 0; t < tileCount; t++) {
+            tile(t);
+        }
+        return;
+    }
+    renderPool->parallelFor(tileCount, tile);
+}
+
+void drawScene(SDL_Surface *surface, Accumulation *accum) {
+    prepareShading();
+    bool antialias = antialiasing.samples > 0 && accum == nullptr;
+    if (antialias) {
+        beginEdgeCapture();
+    }
+
+    if (adaptiveTiles) {
+        drawSceneAdaptive(surface, accum);
+    } else {
+        drawTiles(surface, accum);
+    }
+
+    if (antialias) {
+        refineEdges(surface);
+    }
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <SDL2/SDL.h>
+#include "arrayView.h"
+#include "threadPool.h"
+
+#define BACKGROUND_COLOR {0, 0, 0}
+
+enum lightType {
+    AMBIENT, POINT, DIRECTIONAL
+};
+
+struct Vec2 {
+    float x, y;
+};
+
+struct Vec3 {
+    float x, y, z;
+
+    Vec3 operator+(const Vec3& o) const { return {x + o.x, y + o.y, z + o.z}; }
+    Vec3 operator-(const Vec3& o) const { return {x - o.x, y - o.y, z - o.z}; }
+    Vec3 operator*(float s) const { return {x * s, y * s, z * s}; }
+    float dot(const Vec3& o) const { return x * o.x + y * o.y + z * o.z; }
+    Vec3 cross(const Vec3& o) const {
+        return {
+            y * o.z - z * o.y,
+            z * o.x - x * o.z,
+            x * o.y - y * o.x
+        };
+    }
+    Vec3 normalized() const {
+        float m = std::sqrt(x * x + y * y + z * z);
+        return m > 0.0f ? *this * (1.0f / m) : *this;
+    }
+    float mag() const { return sqrt(x * x + y * y + z * z); }
+};
+
+struct Sphere {
+    Vec3 origin;
+    Vec3 color;
+    float radius;
+    float reflectiveness;
+    int specular;
+    float rSquared;
+};
+
+struct Light {
+    lightType type;
+    float intensity;
+    Vec3 pos;
+    float range; // point lights: fades out as (1 - d^2 / range^2)^2, 0 for no falloff
+};
+
+// What a ray hit, returned by value so shading never writes shared state.
+// primitive is a spheres[] index when mesh is -1, otherwise a triangle
+// (block * TRI_BLOCK_SIZE + lane) of meshes[mesh]; -1 means a miss.
+struct HitRecord {
+    float t;
+    int primitive = -1;
+    int mesh = -1;
+    Vec3 normal;    // unit, facing the ray for triangles
+};
+
+// An occluder remembered for one light on one thread: a spheres[] index when
+// mesh is -1, otherwise a block of meshes[mesh]; -1 means none.
+struct Occluder {
+    int primitive = -1;
+    int mesh = -1;
+};
+
+// the camera as one value, so a frame can latch it
+struct Camera {
+    Vec3 pos;
+    Vec3 forward;
+    Vec3 up;
+    Vec3 right;
+};
+
+struct Material {
+    Vec3 color;
+    int specular;          // -1 for matte
+    float reflectiveness;
+};
+
+// Running sum of samples per pixel for progressive refinement, row-major at
+// RES_X * RES_Y. samples counts the frame being rendered.
+struct Accumulation {
+    std::vector<Vec3> sum;
+    int samples = 0;
+};
+
+// colours of one tile row, one array per channel so packing vectorizes
+struct RowColors {
+    std::vector<float> r, g, b;
+};
+
+// lights[] indices split by type, rebuilt by prepareShading when the lights
+// or lightCutoff change, so the lighting loops never branch on the type. Lights that can never
+// reach lightCutoff are left out.
+struct LightGroups {
+    float ambient = 0.0f; // summed ambient intensity
+    std::vector<int> point;  // no range, they reach everywhere
+    std::vector<int> ranged; // point lights with a range, also in lightTree (lightTree.h)
+    std::vector<int> directional;
+};
+
+// a light worth a shadow ray from some shading point
+struct LightSample {
+    int light;          // lights[] index
+    Vec3 L;             // shadow ray direction, unnormalised
+    float tMax;
+    float contribution; // diffuse plus specular if nothing blocks it
+};
+
+// rays traced, split by what spawned them
+struct RayCounts {
+    uint64_t primary = 0;
+    uint64_t shadow = 0;
+    uint64_t reflection = 0;
+};
+
+// in-memory scene; edit these, then call buildSceneAccel to publish them
+extern std::vector<Sphere> sceneSpheres;
+extern std::vector<Light> sceneLights;
+
+// what the renderer reads: the vectors above or arrays in a mapped scene file
+extern ArrayView<const Sphere> spheres;
+extern ArrayView<const Light> lights;
+
+extern int RES_X;
+extern int RES_Y;
+extern int TILE;
+extern int reflectRecursion;
+extern int FOV;
+extern float TMIN;
+extern int INF;                // miss distance, and tMax for unbounded rays
+extern ThreadPool *renderPool; // drawScene renders serially when null
+extern bool useWavefront;      // renderTile uses the breadth-first executor (wavefront.h)
+extern bool adaptiveTiles;     // drawScene sizes and orders tiles by last frame's costs (tileScheduler.h)
+extern Vec2 pixelOffset;       // where in each pixel camera rays go, {0.5, 0.5} is the centre
+extern float lightCutoff;      // a light adding less than this at a point is skipped, shadow ray and all; see setLightCutoff
+
+extern Vec3 cameraPos;
+extern Vec3 cameraForward;
+extern Vec3 cameraUp;
+extern Vec3 cameraRight;
+
+// rebuilds the sphere BVH and SoA copy from sceneSpheres (reordering it into
+// BVH leaf order) and points spheres[], lights[] and sphereNodes at the result
+void buildSceneAccel();
+Vec3 rotateAroundAxis(const Vec3& vec, const Vec3& axis, float angle);
+void setResolution(int resX, int resY);
+void setFov(int fov);
+void setLightCutoff(float cutoff);
+// lights[] was replaced; buildSceneAccel calls this itself
+void invalidateLights();
+void resetCamera();
+Camera cameraState();
+void applyCamera(const Camera &camera);
+
+// nearest sphere or triangle in (TMIN, tMax); primitive is -1 on a miss
+HitRecord closestIntersection(Vec3 origin, Vec3 dir, float tMax);
+// any-hit query, true as soon as anything is found in (TMIN, tMax). cache is
+// tried first and updated with the blocker.
+bool occluded(Vec3 origin, Vec3 dir, float tMax, Occluder &cache);
+Vec3 traceRay(Vec3 origin, Vec3 dir, int recursionDepth);
+// shading for a known hit along dir from origin
+Vec3 shadeHit(Vec3 origin, Vec3 dir, const HitRecord &hit, int recursionDepth);
+Material hitMaterial(const HitRecord &hit);
+
+// Picks the shading kernel specialised for reflectRecursion, and regroups
+// lights[] and rebuilds lightTree if they changed since the last call;
+// drawScene calls it before every frame.
+void prepareShading();
+extern LightGroups lightGroups;
+
+// Pieces of computeLighting, shared with the wavefront executor so both
+// produce bit-identical images. lightVector returns L and the shadow ray's
+// tMax for a point or directional light. gatherLights appends the lights
+// that could light point, with their unshadowed contributions, in the
+// order both executors sum them; lights behind the surface, out of range
+// or under lightCutoff never get a shadow ray. normal and view (hit to
+// camera) must be unit length.
+template <lightType Type>
+Vec3 lightVector(const Light &light, Vec3 point, float &tMax) {
+    static_assert(Type == POINT || Type == DIRECTIONAL);
+    if constexpr (Type == POINT) {
+        tMax = 1;
+        return light.pos - point;
+    } else {
+        tMax = (float)INF;
+        return light.pos;
+    }
+}
+void gatherLights(Vec3 point, Vec3 normal, Vec3 view, int specular, std::vector<LightSample> &samples);
+// this thread's per-light occluder caches, sized to lights
+std::vector<Occluder> &threadLightOccluders();
+Vec3 reflectRay(Vec3 ray, Vec3 normal);
+
+// camera ray through canvas point (px, py), in pixels from the top left corner
+Vec3 cameraRayDir(float px, float py);
+// Camera rays for pixels x..min(x + PACKET_SIZE, endX) of row y, intersected
+// as one packet. Fills dirs and hits (normals included) and returns the count.
+int tracePrimaryPacket(int x, int y, int endX, Vec3 *dirs, HitRecord *hits);
+// this thread's row buffer, at least width wide
+RowColors &threadRowColors(int width);
+// clamps and packs count colours from row into pixels x.. of row y, through accum when set
+void storeRow(SDL_Surface *surface, int x, int y, int count, RowColors &row, Accumulation *accum);
+
+// ray counts for the tile being rendered on this thread
+extern thread_local RayCounts tileRays;
+// adds tileRays to the frame totals and clears it
+void flushTileRays();
+// With accum set, each sample is added to it and the surface shows the mean.
+void renderTile(SDL_Surface *surface, int startX, int startY, int tileSize, Accumulation *accum = nullptr);
+void drawScene(SDL_Surface *surface, Accumulation *accum = nullptr);
+
+// totals flushed by renderTile once per tile; read them between frames
+RayCounts rayTotals();
+void resetRayTotals();
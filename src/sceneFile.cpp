@@ -0,0 +1,364 @@
+#include "sceneFile.h"
+#include "rayPacket.h"
+#include "mesh.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::cout, std::endl;
+
+// the binary layout is these structs verbatim
+static_assert(sizeof(Vec3) == 12, "scene file layout");
+static_assert(sizeof(Sphere) == 40, "scene file layout");
+static_assert(sizeof(Light) == 24, "scene file layout");
+static_assert(sizeof(BVHNode) == 32, "scene file layout");
+
+void *mappedScene = nullptr;
+size_t mappedSceneSize = 0;
+
+void unloadScene() {
+    if (mappedScene != nullptr) {
+        munmap(mappedScene, mappedSceneSize);
+        mappedScene = nullptr;
+        mappedSceneSize = 0;
+    }
+}
+
+void setCamera(Vec3 pos, Vec3 forward, Vec3 up) {
+    cameraPos = pos;
+    cameraForward = forward.normalized();
+    cameraRight = up.cross(cameraForward).normalized();
+    cameraUp = cameraForward.cross(cameraRight);
+}
+
+bool loadTextScene(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        cout << "Error opening scene " << path << endl;
+        return false;
+    }
+
+    std::vector<Sphere> newSpheres;
+    std::vector<Light> newLights;
+    std::vector<Mesh> newMeshes;
+    Vec3 pos = {0, 0, 0}, forward = {0, 0, 1}, up = {0, 1, 0};
+    int fov = 53;
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream in(line);
+        std::string kind;
+        if (!(in >> kind)) {
+            continue;
+        }
+
+        bool ok;
+        if (kind == "camera") {
+            ok = (bool)(in >> pos.x >> pos.y >> pos.z >> forward.x >> forward.y >> forward.z >> up.x >> up.y >> up.z);
+        } else if (kind == "fov") {
+            ok = (bool)(in >> fov);
+        } else if (kind == "sphere") {
+            Sphere s = {};
+            ok = (bool)(in >> s.origin.x >> s.origin.y >> s.origin.z >> s.radius
+                           >> s.color.x >> s.color.y >> s.color.z >> s.specular >> s.reflectiveness);
+            s.rSquared = s.radius * s.radius;
+            newSpheres.push_back(s);
+        } else if (kind == "light") {
+            std::string type;
+            Light l = {};
+            in >> type >> l.intensity;
+            if (type == "ambient") {
+                l.type = AMBIENT;
+                ok = (bool)in;
+            } else {
+                l.type = type == "point" ? POINT : DIRECTIONAL;
+                ok = (type == "point" || type == "directional") && (in >> l.pos.x >> l.pos.y >> l.pos.z);
+                if (ok && l.type == POINT && !(in >> std::ws).eof()) {
+                    ok = (in >> l.range) && l.range >= 0;
+                }
+            }
+            newLights.push_back(l);
+        } else if (kind == "mesh") {
+            Mesh mesh;
+            std::string meshPath;
+            ok = (bool)(in >> meshPath >> mesh.color.x >> mesh.color.y >> mesh.color.z >> mesh.specular >> mesh.reflectiveness);
+            if (ok && !(in >> std::ws).eof()) {
+                ok = (bool)(in >> mesh.scale >> mesh.offset.x >> mesh.offset.y >> mesh.offset.z);
+            }
+            // relative mesh paths are relative to the scene file
+            size_t slash = path.find_last_of('/');
+            if (ok && meshPath[0] != '/' && slash != std::string::npos) {
+                meshPath = path.substr(0, slash + 1) + meshPath;
+            }
+            ok = ok && loadOBJ(meshPath, mesh);
+            if (ok) {
+                buildMeshAccel(mesh);
+                newMeshes.push_back(std::move(mesh));
+            }
+        } else {
+            ok = false;
+        }
+        // nothing may follow a directive's fields
+        std::string extra;
+        ok = ok && !(in >> extra);
+
+        if (!ok) {
+            cout << "Error in scene " << path << " line " << lineNumber << ": " << line << endl;
+            return false;
+        }
+    }
+
+    unloadScene();
+    sceneSpheres.swap(newSpheres);
+    sceneLights.swap(newLights);
+    meshes.swap(newMeshes);
+    setCamera(pos, forward, up);
+    setFov(fov);
+    buildSceneAccel();
+    return true;
+}
+
+bool validSection(const SceneFileHeader &header, uint64_t offset, uint64_t bytes) {
+    return offset % SCENE_FILE_ALIGN == 0 && offset <= header.fileSize && bytes <= header.fileSize - offset;
+}
+
+// The BVH and lights come from the file as is, so check everything traversal and
+// shading index with: children after their parent (no cycles) and inside the node
+// array, no deeper than the traversal stack, leaves inside spheres[], known light types.
+bool validSceneData(const SceneFileHeader &header, const char *bytes) {
+    const BVHNode *nodes = (const BVHNode*)(bytes + header.nodesOffset);
+    std::vector<int> depth(header.numNodes, 0);
+    for (uint32_t i = 0; i < header.numNodes; i++) {
+        const BVHNode &node = nodes[i];
+        if (node.count > 0) {
+            if (node.leftFirst < 0 || (uint64_t)node.leftFirst + node.count > header.numSpheres) {
+                return false;
+            }
+        } else {
+            if (node.count < 0 || node.leftFirst <= (int64_t)i || (uint64_t)node.leftFirst + 1 >= header.numNodes ||
+                depth[i] + 1 >= BVH_STACK_SIZE) {
+                return false;
+            }
+            depth[node.leftFirst] = std::max(depth[node.leftFirst], depth[i] + 1);
+            depth[node.leftFirst + 1] = std::max(depth[node.leftFirst + 1], depth[i] + 1);
+        }
+    }
+
+    const Light *fileLights = (const Light*)(bytes + header.lightsOffset);
+    for (uint32_t i = 0; i < header.numLights; i++) {
+        const Light &light = fileLights[i];
+        if ((light.type != AMBIENT && light.type != POINT && light.type != DIRECTIONAL) || !(light.range >= 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool loadBinaryScene(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cout << "Error opening scene " << path << endl;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SceneFileHeader)) {
+        cout << "Error: " << path << " is not a scene file" << endl;
+        close(fd);
+        return false;
+    }
+
+    // rendering never writes scene data, so the pages stay clean and shared
+    size_t size = info.st_size;
+    void *base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        cout << "Error mapping scene " << path << endl;
+        return false;
+    }
+
+    const SceneFileHeader &header = *(const SceneFileHeader*)base;
+    bool valid = memcmp(header.magic, "RSCN", 4) == 0 && header.version == SCENE_FILE_VERSION && header.fileSize == size &&
+        (header.numSpheres == 0) == (header.numNodes == 0) &&
+        validSection(header, header.spheresOffset, (uint64_t)header.numSpheres * sizeof(Sphere)) &&
+        validSection(header, header.soaOffset, (uint64_t)header.numSpheres * 4 * sizeof(float)) &&
+        validSection(header, header.lightsOffset, (uint64_t)header.numLights * sizeof(Light)) &&
+        validSection(header, header.nodesOffset, (uint64_t)header.numNodes * sizeof(BVHNode));
+    if (!valid) {
+        cout << "Error: " << path << " is not a version " << SCENE_FILE_VERSION << " scene file" << endl;
+        munmap(base, size);
+        return false;
+    }
+    if (!validSceneData(header, (const char*)base)) {
+        cout << "Error: " << path << " has a corrupt BVH or light table" << endl;
+        munmap(base, size);
+        return false;
+    }
+
+    unloadScene();
+    mappedScene = base;
+    mappedSceneSize = size;
+
+    char *bytes = (char*)base;
+    int n = header.numSpheres;
+    const float *soa = (const float*)(bytes + header.soaOffset);
+    spheres = {(const Sphere*)(bytes + header.spheresOffset), n};
+    lights = {(const Light*)(bytes + header.lightsOffset), (int)header.numLights};
+    invalidateLights();
+    sphereNodes = {(const BVHNode*)(bytes + header.nodesOffset), (int)header.numNodes};
+    sphereSoA.x = {soa, n};
+    sphereSoA.y = {soa + n, n};
+    sphereSoA.z = {soa + 2 * n, n};
+    sphereSoA.rSquared = {soa + 3 * n, n};
+    sphereSoA.count = n;
+
+    // the in-memory copies no longer describe what is being rendered
+    sceneSpheres.clear();
+    sceneLights.clear();
+    meshes.clear();
+
+    // every ray starts at the root, so fetch the nodes and SoA ahead of the first frame
+    madvise(bytes + header.soaOffset, (size_t)n * 4 * sizeof(float), MADV_WILLNEED);
+    madvise(bytes + header.nodesOffset, (size_t)header.numNodes * sizeof(BVHNode), MADV_WILLNEED);
+
+    cameraPos = header.cameraPos;
+    cameraForward = header.cameraForward;
+    cameraUp = header.cameraUp;
+    cameraRight = header.cameraRight;
+    setFov(header.fov);
+    return true;
+}
+
+bool loadScene(const std::string &path) {
+    char magic[4] = {};
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        cout << "Error opening scene " << path << endl;
+        return false;
+    }
+    size_t read = fread(magic, 1, 4, file);
+    fclose(file);
+
+    if (read == 4 && memcmp(magic, "RSCN", 4) == 0) {
+        return loadBinaryScene(path);
+    }
+    return loadTextScene(path);
+}
+
+// meshes keep the path they were opened with; loadTextScene reads mesh paths
+// relative to the scene file, so write them relative to where the scene goes
+std::string meshPathFor(const std::string &scenePath, const std::string &meshPath) {
+    namespace fs = std::filesystem;
+    fs::path mesh = fs::absolute(meshPath).lexically_normal();
+    fs::path relative = mesh.lexically_relative(fs::absolute(scenePath).parent_path().lexically_normal());
+    return relative.empty() ? mesh.string() : relative.string();
+}
+
+bool saveTextScene(const std::string &path) {
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file) {
+        cout << "Error opening " << path << " for writing" << endl;
+        return false;
+    }
+
+    fprintf(file, "camera %.9g %.9g %.9g  %.9g %.9g %.9g  %.9g %.9g %.9g\n", cameraPos.x, cameraPos.y, cameraPos.z,
+        cameraForward.x, cameraForward.y, cameraForward.z, cameraUp.x, cameraUp.y, cameraUp.z);
+    fprintf(file, "fov %d\n", FOV);
+    for (const Light &l : lights) {
+        if (l.type == AMBIENT) {
+            fprintf(file, "light ambient %.9g\n", l.intensity);
+        } else if (l.type == POINT && l.range > 0) {
+            fprintf(file, "light point %.9g  %.9g %.9g %.9g  %.9g\n", l.intensity, l.pos.x, l.pos.y, l.pos.z, l.range);
+        } else {
+            fprintf(file, "light %s %.9g  %.9g %.9g %.9g\n", l.type == POINT ? "point" : "directional",
+                l.intensity, l.pos.x, l.pos.y, l.pos.z);
+        }
+    }
+    for (const Sphere &s : spheres) {
+        fprintf(file, "sphere %.9g %.9g %.9g %.9g  %.9g %.9g %.9g  %d %.9g\n", s.origin.x, s.origin.y, s.origin.z, s.radius,
+            s.color.x, s.color.y, s.color.z, s.specular, s.reflectiveness);
+    }
+    for (const Mesh &m : meshes) {
+        fprintf(file, "mesh %s  %.9g %.9g %.9g  %d %.9g  %.9g  %.9g %.9g %.9g\n", meshPathFor(path, m.path).c_str(), m.color.x, m.color.y, m.color.z,
+            m.specular, m.reflectiveness, m.scale, m.offset.x, m.offset.y, m.offset.z);
+    }
+    fclose(file);
+    return true;
+}
+
+uint64_t alignOffset(uint64_t offset) {
+    return (offset + SCENE_FILE_ALIGN - 1) / SCENE_FILE_ALIGN * SCENE_FILE_ALIGN;
+}
+
+bool writeSection(FILE *file, uint64_t offset, const void *data, size_t bytes) {
+    return fseek(file, (long)offset, SEEK_SET) == 0 && (bytes == 0 || fwrite(data, 1, bytes, file) == bytes);
+}
+
+bool saveBinaryScene(const std::string &path) {
+    if (!meshes.empty()) {
+        cout << "Note: " << path << " stores spheres and lights only, save meshes in a text scene" << endl;
+    }
+    SceneFileHeader header = {};
+    memcpy(header.magic, "RSCN", 4);
+    header.version = SCENE_FILE_VERSION;
+    header.numSpheres = spheres.size();
+    header.numLights = lights.size();
+    header.numNodes = sphereNodes.size();
+    header.fov = FOV;
+    header.cameraPos = cameraPos;
+    header.cameraForward = cameraForward;
+    header.cameraUp = cameraUp;
+    header.cameraRight = cameraRight;
+
+    size_t n = spheres.size();
+    header.spheresOffset = alignOffset(sizeof(SceneFileHeader));
+    header.soaOffset = alignOffset(header.spheresOffset + n * sizeof(Sphere));
+    header.lightsOffset = alignOffset(header.soaOffset + n * 4 * sizeof(float));
+    header.nodesOffset = alignOffset(header.lightsOffset + lights.size() * sizeof(Light));
+    header.fileSize = alignOffset(header.nodesOffset + sphereNodes.size() * sizeof(BVHNode));
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) {
+        cout << "Error opening " << path << " for writing" << endl;
+        return false;
+    }
+
+    bool ok = writeSection(file, 0, &header, sizeof(header)) &&
+        writeSection(file, header.spheresOffset, spheres.data(), n * sizeof(Sphere)) &&
+        writeSection(file, header.soaOffset, sphereSoA.x.data(), n * sizeof(float)) &&
+        writeSection(file, header.soaOffset + n * sizeof(float), sphereSoA.y.data(), n * sizeof(float)) &&
+        writeSection(file, header.soaOffset + 2 * n * sizeof(float), sphereSoA.z.data(), n * sizeof(float)) &&
+        writeSection(file, header.soaOffset + 3 * n * sizeof(float), sphereSoA.rSquared.data(), n * sizeof(float)) &&
+        writeSection(file, header.lightsOffset, lights.data(), lights.size() * sizeof(Light)) &&
+        writeSection(file, header.nodesOffset, sphereNodes.data(), sphereNodes.size() * sizeof(BVHNode));
+
+    // pad the tail so fileSize matches the file on disk
+    char zero = 0;
+    if (header.nodesOffset + sphereNodes.size() * sizeof(BVHNode) < header.fileSize) {
+        ok = ok && writeSection(file, header.fileSize - 1, &zero, 1);
+    }
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        cout << "Error writing " << path << endl;
+    }
+    return ok;
+}
+
+bool convertScene(const std::string &inPath, const std::string &outPath) {
+    if (!loadScene(inPath)) {
+        return false;
+    }
+    bool binary = outPath.size() >= 5 && outPath.compare(outPath.size() - 5, 5, ".rscn") == 0;
+    return binary ? saveBinaryScene(outPath) : saveTextScene(outPath);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "renderer.h"
+#include "bvh.h"
+
+// Binary scenes (.rscn) are the renderer's own arrays laid out back to back,
+// already in BVH leaf order with the BVH included. Loading one is an mmap plus
+// pointer setup; nothing is parsed or copied. The layout is native-endian and
+// tied to the struct layouts below, so rebuild .rscn files from the text form
+// when those change. Meshes are not stored; they live in text scenes only.
+//
+// Text scenes are for authoring, one item per line, '#' starts a comment:
+//   camera <pos xyz> <forward xyz> <up xyz>
+//   fov <degrees>
+//   sphere <center xyz> <radius> <color rgb 0-255> <specular, -1 for matte> <reflectiveness 0-1>
+//   light ambient <intensity>
+//   light point <intensity> <position xyz> [<range>]
+//   light directional <intensity> <direction xyz>
+//   mesh <obj path> <color rgb 0-255> <specular> <reflectiveness> [<scale> <offset xyz>]
+
+constexpr uint32_t SCENE_FILE_VERSION = 3;
+constexpr uint64_t SCENE_FILE_ALIGN = 64;
+
+struct SceneFileHeader {
+    char magic[4];          // "RSCN"
+    uint32_t version;
+    uint32_t numSpheres;
+    uint32_t numLights;
+    uint32_t numNodes;
+    int32_t fov;
+    Vec3 cameraPos;
+    Vec3 cameraForward;
+    Vec3 cameraUp;
+    Vec3 cameraRight;
+    // byte offsets from the start of the file, each SCENE_FILE_ALIGN aligned
+    uint64_t spheresOffset; // Sphere[numSpheres]
+    uint64_t soaOffset;     // float x[n], y[n], z[n], rSquared[n]
+    uint64_t lightsOffset;  // Light[numLights]
+    uint64_t nodesOffset;   // BVHNode[numNodes]
+    uint64_t fileSize;
+};
+
+// picks the format from the file contents
+bool loadScene(const std::string &path);
+bool loadTextScene(const std::string &path);
+bool loadBinaryScene(const std::string &path);
+
+// save the scene the renderer currently sees
+bool saveTextScene(const std::string &path);
+bool saveBinaryScene(const std::string &path);
+
+// .rscn output is binary, anything else is text
+bool convertScene(const std::string &inPath, const std::string &outPath);
+
+// drops the current mapping, if any
+void unloadScene();
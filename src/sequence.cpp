@@ -0,0 +1,135 @@
+#include "sequence.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+bool loadCameraPath(const std::string &path, std::vector<CameraKey> &keys) {
+    std::ifstream file(path);
+    if (!file) {
+        fprintf(stderr, "Error opening camera path %s\n", path.c_str());
+        return false;
+    }
+
+    keys.clear();
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream in(line);
+        std::string kind;
+        if (!(in >> kind)) {
+            continue;
+        }
+
+        CameraKey k;
+        bool ok = kind == "key" && (in >> k.time >> k.pos.x >> k.pos.y >> k.pos.z >> k.forward.x >> k.forward.y >> k.forward.z
+                                      >> k.up.x >> k.up.y >> k.up.z);
+        ok = ok && (keys.empty() || k.time > keys.back().time);
+        if (!ok) {
+            fprintf(stderr, "Error in camera path %s line %d: %s\n", path.c_str(), lineNumber, line.c_str());
+            return false;
+        }
+        k.forward = k.forward.normalized();
+        k.up = k.up.normalized();
+        keys.push_back(k);
+    }
+
+    if (keys.empty()) {
+        fprintf(stderr, "Error: camera path %s has no keys\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Catmull-Rom through p1 and p2, with p0 and p3 as the neighbours
+Vec3 catmullRom(Vec3 p0, Vec3 p1, Vec3 p2, Vec3 p3, float t) {
+    float t2 = t * t;
+    float t3 = t2 * t;
+    return (p1 * 2 + (p2 - p0) * t + (p0 * 2 - p1 * 5 + p2 * 4 - p3) * t2 + (p1 * 3 - p0 - p2 * 3 + p3) * t3) * 0.5f;
+}
+
+// turns unit a toward unit b by fraction t of the angle between them
+Vec3 slerpDirection(Vec3 a, Vec3 b, float t) {
+    Vec3 axis = a.cross(b);
+    float angle = std::atan2(axis.mag(), a.dot(b));
+    if (axis.mag() < 1e-6f) {
+        // parallel, or opposite with no preferred way round
+        return (a * (1 - t) + b * t).normalized();
+    }
+    return rotateAroundAxis(a, axis, angle * t);
+}
+
+Camera cameraAt(const std::vector<CameraKey> &keys, float time) {
+    auto next = std::upper_bound(keys.begin(), keys.end(), time, [](float t, const CameraKey &k) { return t < k.time; });
+    int i1 = std::clamp((int)(next - keys.begin()) - 1, 0, (int)keys.size() - 1);
+    int i2 = std::min(i1 + 1, (int)keys.size() - 1);
+    const CameraKey &k1 = keys[i1];
+    const CameraKey &k2 = keys[i2];
+    float t = i1 == i2 ? 0.0f : std::clamp((time - k1.time) / (k2.time - k1.time), 0.0f, 1.0f);
+
+    Vec3 pos = catmullRom(keys[std::max(i1 - 1, 0)].pos, k1.pos, k2.pos, keys[std::min(i2 + 1, (int)keys.size() - 1)].pos, t);
+    Vec3 forward = slerpDirection(k1.forward, k2.forward, t).normalized();
+    Vec3 up = slerpDirection(k1.up, k2.up, t);
+
+    Vec3 right = up.cross(forward).normalized();
+    return {pos, forward, right.mag() > 0 ? forward.cross(right) : up, right};
+}
+
+int renderSequence(const BenchConfig &config, const SequenceConfig &sequence) {
+    std::vector<CameraKey> keys;
+    if (!loadCameraPath(sequence.path, keys)) {
+        return 1;
+    }
+
+    bool toStdout = sequence.out == "-";
+    FILE *out = toStdout ? stdout : fopen(sequence.out.c_str(), "wb");
+    if (!out) {
+        fprintf(stderr, "Error opening %s for writing\n", sequence.out.c_str());
+        return 1;
+    }
+
+    applyConfig(config);
+    auto start = std::chrono::steady_clock::now();
+    double renderSeconds = 0;
+    bool ok = true;
+    {
+        FrameWriter writer(out, sequence.format, RES_X, RES_Y, sequence.fps, std::max(sequence.buffers, 2));
+        float firstTime = keys.front().time;
+        float span = keys.back().time - firstTime;
+        for (int i = 0; i < sequence.frames && ok; i++) {
+            SDL_Surface *frame = writer.acquire();
+            if (frame == nullptr) {
+                ok = false;
+                break;
+            }
+            float time = firstTime + (sequence.frames > 1 ? span * i / (sequence.frames - 1) : 0.0f);
+            applyCamera(cameraAt(keys, time));
+
+            auto renderStart = std::chrono::steady_clock::now();
+            drawScene(frame);
+            renderSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+            writer.submit(frame);
+
+            if ((i + 1) % 100 == 0) {
+                fprintf(stderr, "frame %d/%d\n", i + 1, sequence.frames);
+            }
+        }
+        ok = writer.finish() && ok;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        fprintf(stderr, "Rendered %d frames at %dx%d in %.2f s, %.2f fps, render %.1f ms/frame, waited on output %.1f ms\n",
+            sequence.frames, RES_X, RES_Y, seconds, sequence.frames / seconds, renderSeconds * 1000 / sequence.frames,
+            writer.stallMs());
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Error writing %s\n", toStdout ? "stdout" : sequence.out.c_str());
+    }
+    if (!toStdout && fclose(out) != 0) {
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
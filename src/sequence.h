@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "frameWriter.h"
+
+// A camera keyframe path, one key per line, '#' starts a comment:
+//   key <time> <pos xyz> <forward xyz> <up xyz>
+// Keys must be in increasing time order. Positions follow a Catmull-Rom
+// spline through the keys; forward and up turn along the great circle
+// between neighbouring keys, and the camera is re-orthonormalised the way
+// the scene file's camera line is.
+struct CameraKey {
+    float time;
+    Vec3 pos;
+    Vec3 forward;
+    Vec3 up;
+};
+
+bool loadCameraPath(const std::string &path, std::vector<CameraKey> &keys);
+
+// the camera at time, clamped to the path's ends
+Camera cameraAt(const std::vector<CameraKey> &keys, float time);
+
+struct SequenceConfig {
+    std::string path;      // camera keyframe file
+    int frames = 100;      // spread evenly from the first key's time to the last's
+    std::string out = "-"; // "-" for stdout
+    FrameFormat format = FRAME_Y4M;
+    int fps = 30;          // Y4M frame rate
+    int buffers = 4;       // frames in memory, see FrameWriter
+};
+
+// Renders the sequence headless and streams it through a FrameWriter. Progress
+// goes to stderr so stdout can carry the frames.
+int renderSequence(const BenchConfig &config, const SequenceConfig &sequence);
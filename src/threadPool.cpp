@@ -0,0 +1,129 @@
+#include "threadPool.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+ThreadPool::ThreadPool(int workerCount, bool pin) {
+    if (workerCount <= 0) {
+        workerCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (int i = 0; i < workerCount; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+#ifdef __linux__
+    // the CPUs this process may use, so taskset and cgroup limits are respected
+    std::vector<int> allowedCpus;
+    cpu_set_t processCpus;
+    if (pin && sched_getaffinity(0, sizeof(processCpus), &processCpus) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &processCpus)) {
+                allowedCpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+    for (int i = 0; i < workerCount; i++) {
+        workers[i]->thread = std::thread(&ThreadPool::workerLoop, this, i);
+#ifdef __linux__
+        if (!allowedCpus.empty()) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(allowedCpus[i % allowedCpus.size()], &cpus);
+            pthread_setaffinity_np(workers[i]->thread.native_handle(), sizeof(cpus), &cpus);
+        }
+#else
+        (void)pin; // no portable affinity API, workers float
+#endif
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) {
+        worker->thread.join();
+    }
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)> &job) {
+    if (count <= 0) {
+        return;
+    }
+
+    // contiguous runs keep neighbouring tiles on the same worker until stolen
+    int workerCount = size();
+    currentJob = &job;
+    remaining = count;
+    for (int w = 0; w < workerCount; w++) {
+        int begin = (int)((int64_t)count * w / workerCount);
+        int end = (int)((int64_t)count * (w + 1) / workerCount);
+        std::lock_guard<std::mutex> guard(workers[w]->lock);
+        for (int i = begin; i < end; i++) {
+            workers[w]->tasks.push_back(i);
+        }
+    }
+
+    std::unique_lock<std::mutex> guard(stateLock);
+    generation++;
+    wake.notify_all();
+    done.wait(guard, [&] { return remaining.load() == 0; });
+    currentJob = nullptr;
+}
+
+bool ThreadPool::popTask(int index, int &task) {
+    Worker &worker = *workers[index];
+    std::lock_guard<std::mutex> guard(worker.lock);
+    if (worker.tasks.empty()) {
+        return false;
+    }
+    task = worker.tasks.front();
+    worker.tasks.pop_front();
+    return true;
+}
+
+bool ThreadPool::stealTask(int index, int &task) {
+    int workerCount = size();
+    for (int offset = 1; offset < workerCount; offset++) {
+        Worker &victim = *workers[(index + offset) % workerCount];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(int index) {
+    PROFILE_THREAD_NAME("worker");
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(stateLock);
+            wake.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+
+        int task;
+        while (popTask(index, task) || stealTask(index, task)) {
+            (*currentJob)(task);
+            if (--remaining == 0) {
+                std::lock_guard<std::mutex> guard(stateLock);
+                done.notify_all();
+            }
+        }
+    }
+}
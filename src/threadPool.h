@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Long-lived workers with one deque each. parallelFor deals the indices out
+// in contiguous runs, workers pop their own front and steal from the back of
+// the others, and the call returns once every index has run.
+class ThreadPool {
+public:
+    // workerCount <= 0 uses every hardware thread
+    explicit ThreadPool(int workerCount = 0, bool pin = false);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return (int)workers.size(); }
+
+    // runs job(i) for every i in [0, count) and waits for all of them
+    void parallelFor(int count, const std::function<void(int)> &job);
+
+private:
+    struct Worker {
+        std::mutex lock;
+        std::deque<int> tasks;
+        std::thread thread;
+    };
+
+    void workerLoop(int index);
+    bool popTask(int index, int &task);
+    bool stealTask(int index, int &task);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    const std::function<void(int)> *currentJob = nullptr;
+
+    std::mutex stateLock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t generation = 0;
+    std::atomic<int> remaining{0};
+    bool stopping = false;
+};
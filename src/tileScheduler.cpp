@@ -0,0 +1,167 @@
+#include "tileScheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+const int COST_GRID = 64;        // density cells per side, over the whole frame
+const int ROOT_TILE = 128;       // merged tiles never grow past this
+const int MIN_TILE = 8;          // splits stop here, one packet per row
+const int TILES_PER_THREAD = 16; // enough short tiles at the end to even the threads out
+
+struct ScheduledTile {
+    int x, y, size;
+    double cost;  // estimate from the density map
+    int64_t ns;   // measured
+};
+
+// nanoseconds per unit of frame area (the frame is 1 x 1), row-major
+std::vector<double> costDensity;
+std::vector<ScheduledTile> scheduledTiles;
+
+void resetTileCosts() {
+    costDensity.clear();
+}
+
+// a tile's extent in normalised frame coordinates, clipped to the frame
+void tileBounds(int x, int y, int size, double &x0, double &y0, double &x1, double &y1) {
+    x0 = (double)x / RES_X;
+    y0 = (double)y / RES_Y;
+    x1 = (double)std::min(x + size, RES_X) / RES_X;
+    y1 = (double)std::min(y + size, RES_Y) / RES_Y;
+}
+
+// calls f(cell, overlap area) for every density cell the rectangle touches
+template <typename F>
+void forCells(double x0, double y0, double x1, double y1, F f) {
+    int cx0 = std::min((int)(x0 * COST_GRID), COST_GRID - 1);
+    int cy0 = std::min((int)(y0 * COST_GRID), COST_GRID - 1);
+    int cx1 = std::min((int)std::ceil(x1 * COST_GRID), COST_GRID);
+    int cy1 = std::min((int)std::ceil(y1 * COST_GRID), COST_GRID);
+    for (int cy = cy0; cy < cy1; cy++) {
+        double h = std::min(y1, (cy + 1.0) / COST_GRID) - std::max(y0, (double)cy / COST_GRID);
+        for (int cx = cx0; cx < cx1; cx++) {
+            double w = std::min(x1, (cx + 1.0) / COST_GRID) - std::max(x0, (double)cx / COST_GRID);
+            if (w > 0 && h > 0) {
+                f(cy * COST_GRID + cx, w * h);
+            }
+        }
+    }
+}
+
+double estimateCost(int x, int y, int size) {
+    double x0, y0, x1, y1;
+    tileBounds(x, y, size, x0, y0, x1, y1);
+    if (costDensity.empty()) {
+        return (x1 - x0) * (y1 - y0);
+    }
+    double cost = 0;
+    forCells(x0, y0, x1, y1, [&](int cell, double area) { cost += costDensity[cell] * area; });
+    return cost;
+}
+
+// quadtree over one root block; children go in Z order, so the output is a Morton walk
+void splitTile(int x, int y, int size, double target, std::vector<ScheduledTile> &tiles) {
+    if (x >= RES_X || y >= RES_Y) {
+        return;
+    }
+    double cost = estimateCost(x, y, size);
+    if (cost <= target || size <= MIN_TILE) {
+        tiles.push_back({x, y, size, cost, 0});
+        return;
+    }
+    int half = size / 2;
+    splitTile(x, y, half, target, tiles);
+    splitTile(x + half, y, half, target, tiles);
+    splitTile(x, y + half, half, target, tiles);
+    splitTile(x + half, y + half, half, target, tiles);
+}
+
+// interleaves the low 16 bits of x and y
+uint32_t mortonKey(uint32_t x, uint32_t y) {
+    auto spread = [](uint32_t v) {
+        v = (v | (v << 8)) & 0x00FF00FF;
+        v = (v | (v << 4)) & 0x0F0F0F0F;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    };
+    return (spread(y) << 1) | spread(x);
+}
+
+void planTiles(std::vector<ScheduledTile> &tiles) {
+    int rootsX = (RES_X + ROOT_TILE - 1) / ROOT_TILE;
+    int rootsY = (RES_Y + ROOT_TILE - 1) / ROOT_TILE;
+    std::vector<uint32_t> roots;
+    for (int ry = 0; ry < rootsY; ry++) {
+        for (int rx = 0; rx < rootsX; rx++) {
+            roots.push_back(mortonKey(rx, ry));
+        }
+    }
+    std::sort(roots.begin(), roots.end());
+
+    // an even share of the frame's cost per tile, TILES_PER_THREAD tiles per thread
+    int threads = renderPool != nullptr ? std::max(renderPool->size(), 1) : 1;
+    double target = estimateCost(0, 0, std::max(RES_X, RES_Y)) / (threads * TILES_PER_THREAD);
+
+    tiles.clear();
+    for (uint32_t key : roots) {
+        uint32_t rx = 0, ry = 0;
+        for (int bit = 0; bit < 16; bit++) {
+            rx |= ((key >> (2 * bit)) & 1) << bit;
+            ry |= ((key >> (2 * bit + 1)) & 1) << bit;
+        }
+        splitTile(rx * ROOT_TILE, ry * ROOT_TILE, ROOT_TILE, target, tiles);
+    }
+
+    // most expensive first, by power-of-two cost class so similar tiles keep their Morton order
+    auto costClass = [](const ScheduledTile &t) { return t.cost > 0 ? std::ilogb(t.cost) : INT_MIN; };
+    std::stable_sort(tiles.begin(), tiles.end(), [&](const ScheduledTile &a, const ScheduledTile &b) {
+        return costClass(a) > costClass(b);
+    });
+}
+
+// replaces the density map with this frame's measurements
+void recordCosts(const std::vector<ScheduledTile> &tiles) {
+    std::vector<double> cellCost(COST_GRID * COST_GRID, 0.0);
+    for (const ScheduledTile &tile : tiles) {
+        double x0, y0, x1, y1;
+        tileBounds(tile.x, tile.y, tile.size, x0, y0, x1, y1);
+        double density = tile.ns / ((x1 - x0) * (y1 - y0));
+        forCells(x0, y0, x1, y1, [&](int cell, double area) { cellCost[cell] += density * area; });
+    }
+    double cellArea = 1.0 / (COST_GRID * COST_GRID);
+    costDensity.resize(cellCost.size());
+    for (size_t i = 0; i < cellCost.size(); i++) {
+        // never zero, so a region that was free last frame still gets split if it turns expensive
+        costDensity[i] = std::max(cellCost[i] / cellArea, 1.0);
+    }
+}
+
+void drawSceneAdaptive(SDL_Surface *surface, Accumulation *accum) {
+    std::vector<ScheduledTile> &tiles = scheduledTiles;
+    planTiles(tiles);
+
+    std::atomic<int> next{0};
+    auto work = [&](int) {
+        int i;
+        while ((i = next.fetch_add(1, std::memory_order_relaxed)) < (int)tiles.size()) {
+            ScheduledTile &tile = tiles[i];
+            auto start = std::chrono::steady_clock::now();
+            renderTile(surface, tile.x, tile.y, tile.size, accum);
+            tile.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+    };
+
+    // one puller per thread, so tiles start strictly in the planned order
+    if (renderPool == nullptr) {
+        work(0);
+    } else {
+        renderPool->parallelFor(std::max(renderPool->size(), 1), work);
+    }
+    recordCosts(tiles);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "renderer.h"
+
+// Cost-guided tiling for drawScene. Each frame's tile timings are folded into
+// a cost density map over the frame (normalised, so it survives resolution
+// changes); the next frame is cut by a quadtree over that map. Regions that
+// cost more than a per-thread share are split down to MIN_TILE, cheap ones
+// stay merged up to ROOT_TILE. Tiles come out in Morton order, are then
+// stably sorted most expensive first, and threads pull them from one shared
+// counter, so the long tiles start early and the short ones fill in the end.
+
+// renders a frame with the adaptive tiling; drawScene calls it when adaptiveTiles is set
+void drawSceneAdaptive(SDL_Surface *surface, Accumulation *accum);
+
+// forgets the cost map, so the next frame starts from uniform costs
+void resetTileCosts();
@@ -0,0 +1,175 @@
+#include "triangle.h"
+#include "rayPacket.h"
+
+#if defined(__x86_64__)
+#define TRIANGLE_X86
+#include <immintrin.h>
+#endif
+
+// determinants smaller than this are treated as rays parallel to the triangle
+constexpr float TRI_EPSILON = 1e-9f;
+
+Vec3 triangleNormal(const TriangleBlock &block, int lane) {
+    Vec3 e1 = {block.e1x[lane], block.e1y[lane], block.e1z[lane]};
+    Vec3 e2 = {block.e2x[lane], block.e2y[lane], block.e2z[lane]};
+    return e1.cross(e2);
+}
+
+int intersectBlockScalar(const TriangleBlock &block, const Vec3& origin, const Vec3& dir, float &tMax) {
+    int hit = -1;
+    for (int lane = 0; lane < TRI_BLOCK_SIZE; lane++) {
+        Vec3 e1 = {block.e1x[lane], block.e1y[lane], block.e1z[lane]};
+        Vec3 e2 = {block.e2x[lane], block.e2y[lane], block.e2z[lane]};
+        Vec3 p = dir.cross(e2);
+        float det = e1.dot(p);
+        if (std::fabs(det) < TRI_EPSILON) {
+            continue;
+        }
+        float invDet = 1.0f / det;
+        Vec3 s = origin - Vec3 {block.v0x[lane], block.v0y[lane], block.v0z[lane]};
+        float u = s.dot(p) * invDet;
+        if (u < 0 || u > 1) {
+            continue;
+        }
+        Vec3 q = s.cross(e1);
+        float v = dir.dot(q) * invDet;
+        if (v < 0 || u + v > 1) {
+            continue;
+        }
+        float t = e2.dot(q) * invDet;
+        if (t > TMIN && t < tMax) {
+            tMax = t;
+            hit = lane;
+        }
+    }
+    return hit;
+}
+
+#ifdef TRIANGLE_X86
+
+// picks the nearest lane out of a vector of candidate distances (INFINITY = miss)
+template <int Lanes>
+int nearestLane(const float *t, float &tMax) {
+    int hit = -1;
+    for (int lane = 0; lane < Lanes; lane++) {
+        if (t[lane] < tMax) {
+            tMax = t[lane];
+            hit = lane;
+        }
+    }
+    return hit;
+}
+
+int intersectBlockSSE(const TriangleBlock &block, const Vec3& origin, const Vec3& dir, float &tMax) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 eps = _mm_set1_ps(TRI_EPSILON);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 dx = _mm_set1_ps(dir.x), dy = _mm_set1_ps(dir.y), dz = _mm_set1_ps(dir.z);
+
+    int hit = -1;
+    for (int base = 0; base < TRI_BLOCK_SIZE; base += 4) {
+        __m128 e1x = _mm_loadu_ps(block.e1x + base), e1y = _mm_loadu_ps(block.e1y + base), e1z = _mm_loadu_ps(block.e1z + base);
+        __m128 e2x = _mm_loadu_ps(block.e2x + base), e2y = _mm_loadu_ps(block.e2y + base), e2z = _mm_loadu_ps(block.e2z + base);
+
+        // p = dir x e2, det = e1 . p
+        __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        __m128 valid = _mm_cmpge_ps(_mm_and_ps(det, absMask), eps);
+        if (_mm_movemask_ps(valid) == 0) {
+            continue;
+        }
+        __m128 invDet = _mm_div_ps(one, det);
+
+        __m128 sx = _mm_sub_ps(_mm_set1_ps(origin.x), _mm_loadu_ps(block.v0x + base));
+        __m128 sy = _mm_sub_ps(_mm_set1_ps(origin.y), _mm_loadu_ps(block.v0y + base));
+        __m128 sz = _mm_sub_ps(_mm_set1_ps(origin.z), _mm_loadu_ps(block.v0z + base));
+        __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+        // q = s x e1
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+        __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+        __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+        valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+        valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, _mm_set1_ps(TMIN)));
+        valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(tMax)));
+        if (_mm_movemask_ps(valid) == 0) {
+            continue;
+        }
+
+        alignas(16) float candidates[4];
+        _mm_store_ps(candidates, _mm_or_ps(_mm_and_ps(valid, t), _mm_andnot_ps(valid, _mm_set1_ps(INFINITY))));
+        int lane = nearestLane<4>(candidates, tMax);
+        if (lane >= 0) {
+            hit = base + lane;
+        }
+    }
+    return hit;
+}
+
+__attribute__((target("avx2")))
+int intersectBlockAVX2(const TriangleBlock &block, const Vec3& origin, const Vec3& dir, float &tMax) {
+    static_assert(TRI_BLOCK_SIZE == 8, "AVX2 kernel assumes one block per register");
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 dx = _mm256_set1_ps(dir.x), dy = _mm256_set1_ps(dir.y), dz = _mm256_set1_ps(dir.z);
+
+    __m256 e1x = _mm256_loadu_ps(block.e1x), e1y = _mm256_loadu_ps(block.e1y), e1z = _mm256_loadu_ps(block.e1z);
+    __m256 e2x = _mm256_loadu_ps(block.e2x), e2y = _mm256_loadu_ps(block.e2y), e2z = _mm256_loadu_ps(block.e2z);
+
+    __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+    __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+    __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+    __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+    __m256 valid = _mm256_cmp_ps(_mm256_and_ps(det, absMask), _mm256_set1_ps(TRI_EPSILON), _CMP_GE_OQ);
+    if (_mm256_movemask_ps(valid) == 0) {
+        return -1;
+    }
+    __m256 invDet = _mm256_div_ps(one, det);
+
+    __m256 sx = _mm256_sub_ps(_mm256_set1_ps(origin.x), _mm256_loadu_ps(block.v0x));
+    __m256 sy = _mm256_sub_ps(_mm256_set1_ps(origin.y), _mm256_loadu_ps(block.v0y));
+    __m256 sz = _mm256_sub_ps(_mm256_set1_ps(origin.z), _mm256_loadu_ps(block.v0z));
+    __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), invDet);
+
+    __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+    __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+    __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+    __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), invDet);
+    __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), invDet);
+
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(TMIN), _CMP_GT_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(tMax), _CMP_LT_OQ));
+    if (_mm256_movemask_ps(valid) == 0) {
+        return -1;
+    }
+
+    alignas(32) float candidates[8];
+    _mm256_store_ps(candidates, _mm256_blendv_ps(_mm256_set1_ps(INFINITY), t, valid));
+    return nearestLane<8>(candidates, tMax);
+}
+
+#endif
+
+TriangleKernel triangleKernel = intersectBlockScalar;
+
+void setTriangleKernel(int level) {
+    switch (level) {
+#ifdef TRIANGLE_X86
+        case SIMD_AVX2: triangleKernel = intersectBlockAVX2; break;
+        case SIMD_SSE: triangleKernel = intersectBlockSSE; break;
+#endif
+        default: triangleKernel = intersectBlockScalar; break;
+    }
+}
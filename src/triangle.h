@@ -0,0 +1,26 @@
+#pragma once
+
+#include "renderer.h"
+
+// triangles per block; mesh BVH leaves hold one block each
+constexpr int TRI_BLOCK_SIZE = 8;
+
+// Möller–Trumbore inputs for TRI_BLOCK_SIZE triangles, one array per field.
+// Unused lanes have zero edges and never report a hit.
+struct TriangleBlock {
+    float v0x[TRI_BLOCK_SIZE], v0y[TRI_BLOCK_SIZE], v0z[TRI_BLOCK_SIZE];
+    float e1x[TRI_BLOCK_SIZE], e1y[TRI_BLOCK_SIZE], e1z[TRI_BLOCK_SIZE];
+    float e2x[TRI_BLOCK_SIZE], e2y[TRI_BLOCK_SIZE], e2z[TRI_BLOCK_SIZE];
+};
+
+// tests one ray against every triangle of the block; on a hit in (TMIN, tMax)
+// lowers tMax and returns the lane, otherwise returns -1
+typedef int (*TriangleKernel)(const TriangleBlock &block, const Vec3& origin, const Vec3& dir, float &tMax);
+
+extern TriangleKernel triangleKernel;
+
+// called by setSimdLevel
+void setTriangleKernel(int simdLevel);
+
+// e1 x e2, not normalized
+Vec3 triangleNormal(const TriangleBlock &block, int lane);
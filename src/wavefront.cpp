@@ -0,0 +1,192 @@
+#include "wavefront.h"
+#include "rayPacket.h"
+
+#include <algorithm>
+#include <cstdint>
+
+// a ray that hit something and is waiting to be shaded
+struct WaveRay {
+    int pixel; // row-major within the tile
+    Vec3 origin;
+    Vec3 dir;
+    HitRecord hit;
+};
+
+// a reflection ray waiting to be intersected
+struct BounceRay {
+    int pixel;
+    Vec3 origin;
+    Vec3 dir;
+};
+
+// one shading point on a pixel's path; reflectiveness is -1 where the path ends
+struct PathVertex {
+    Vec3 local;
+    float reflectiveness;
+};
+
+// queues reused from tile to tile, so steady state allocates nothing
+struct WavefrontQueues {
+    std::vector<WaveRay> rays;
+    std::vector<BounceRay> bounces;
+    std::vector<uint64_t> bounceOrder; // direction key << 32 | index into bounces
+    std::vector<Vec3> points;          // hit point per ray
+    std::vector<LightSample> samples;  // gathered lights, ray by ray
+    std::vector<int> firstSample;      // per ray, then one past the last sample
+    std::vector<int> sampleRay;        // per sample
+    std::vector<uint64_t> shadowOrder; // light << 32 | index into samples
+    std::vector<uint8_t> visible;      // per sample
+    std::vector<PathVertex> path;      // pixel * pathVertices() + bounce
+    std::vector<int> pathLength;
+};
+
+thread_local WavefrontQueues queues;
+
+// spreads the low 10 bits of v to every third bit
+inline uint32_t spreadBits(uint32_t v) {
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8)) & 0x0300F00F;
+    v = (v | (v << 4)) & 0x030C30C3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+// Morton code of the quantised unit direction, so rays heading the same way
+// are adjacent and walk the same BVH nodes back to back
+uint32_t directionKey(Vec3 dir) {
+    Vec3 d = dir.normalized();
+    auto quantise = [](float c) { return (uint32_t)std::clamp((c + 1.0f) * 512.0f, 0.0f, 1023.0f); };
+    return (spreadBits(quantise(d.x)) << 2) | (spreadBits(quantise(d.y)) << 1) | spreadBits(quantise(d.z));
+}
+
+// shading points per pixel; a negative depth shades the first hit only, like traceRay
+int pathVertices() {
+    return std::max(reflectRecursion, 0) + 1;
+}
+
+// every gathered sample's shadow ray, light by light so each light's occluder cache stays hot
+void traceShadows() {
+    std::vector<LightSample> &samples = queues.samples;
+    queues.shadowOrder.resize(samples.size());
+    for (size_t i = 0; i < samples.size(); i++) {
+        queues.shadowOrder[i] = (uint64_t)samples[i].light << 32 | i;
+    }
+    std::sort(queues.shadowOrder.begin(), queues.shadowOrder.end());
+
+    std::vector<Occluder> &occluders = threadLightOccluders();
+    queues.visible.resize(samples.size());
+    for (uint64_t entry : queues.shadowOrder) {
+        uint32_t i = (uint32_t)entry;
+        const LightSample &sample = samples[i];
+        queues.visible[i] = !occluded(queues.points[queues.sampleRay[i]], sample.L, sample.tMax, occluders[sample.light]);
+    }
+}
+
+void shadeWave(int bounce, int depthLeft) {
+    std::vector<WaveRay> &rays = queues.rays;
+    int rayCount = (int)rays.size();
+    int maxVertices = pathVertices();
+
+    queues.points.resize(rayCount);
+    for (int i = 0; i < rayCount; i++) {
+        queues.points[i] = rays[i].origin + rays[i].dir * rays[i].hit.t;
+    }
+
+    // light stage: what reaches each point, then the shadow rays for those
+    queues.samples.clear();
+    queues.sampleRay.clear();
+    queues.firstSample.resize(rayCount + 1);
+    for (int i = 0; i < rayCount; i++) {
+        queues.firstSample[i] = (int)queues.samples.size();
+        gatherLights(queues.points[i], rays[i].hit.normal, (rays[i].dir * -1).normalized(), hitMaterial(rays[i].hit).specular,
+            queues.samples);
+        queues.sampleRay.resize(queues.samples.size(), i);
+    }
+    queues.firstSample[rayCount] = (int)queues.samples.size();
+    traceShadows();
+
+    // shading stage, same arithmetic in the same order as computeLighting
+    queues.bounces.clear();
+    for (int i = 0; i < rayCount; i++) {
+        const WaveRay &ray = rays[i];
+        Material material = hitMaterial(ray.hit);
+        Vec3 pointToCamera = ray.dir * -1;
+        float intensity = lightGroups.ambient;
+        for (int j = queues.firstSample[i]; j < queues.firstSample[i + 1]; j++) {
+            if (queues.visible[j]) {
+                intensity += queues.samples[j].contribution;
+            }
+        }
+
+        float r = material.reflectiveness;
+        bool reflects = depthLeft > 0 && r > 0;
+        queues.path[(size_t)ray.pixel * maxVertices + bounce] = {material.color * intensity, reflects ? r : -1.0f};
+        queues.pathLength[ray.pixel] = bounce + 1;
+        if (reflects) {
+            queues.bounces.push_back({ray.pixel, queues.points[i], reflectRay(pointToCamera, ray.hit.normal)});
+        }
+    }
+}
+
+void traceBounces() {
+    std::vector<BounceRay> &bounces = queues.bounces;
+    tileRays.reflection += bounces.size();
+
+    queues.bounceOrder.resize(bounces.size());
+    for (size_t i = 0; i < bounces.size(); i++) {
+        queues.bounceOrder[i] = (uint64_t)directionKey(bounces[i].dir) << 32 | i;
+    }
+    std::sort(queues.bounceOrder.begin(), queues.bounceOrder.end());
+
+    queues.rays.clear();
+    for (uint64_t entry : queues.bounceOrder) {
+        const BounceRay &bounce = bounces[(uint32_t)entry];
+        HitRecord hit = closestIntersection(bounce.origin, bounce.dir, (float)INF);
+        if (hit.primitive >= 0) {
+            queues.rays.push_back({bounce.pixel, bounce.origin, bounce.dir, hit});
+        }
+    }
+}
+
+void traceTileWavefront(SDL_Surface *surface, int startX, int startY, int endX, int endY, Accumulation *accum) {
+    int width = endX - startX;
+    int pixels = width * (endY - startY);
+    int maxVertices = pathVertices();
+    queues.path.resize((size_t)pixels * maxVertices);
+    queues.pathLength.assign(pixels, 0);
+
+    // primary stage; misses never enter the queue
+    queues.rays.clear();
+    Vec3 dirs[PACKET_SIZE];
+    HitRecord hits[PACKET_SIZE];
+    for (int y = startY; y < endY; y++) {
+        for (int x = startX; x < endX; x += PACKET_SIZE) {
+            int count = tracePrimaryPacket(x, y, endX, dirs, hits);
+            for (int lane = 0; lane < count; lane++) {
+                if (hits[lane].primitive >= 0) {
+                    queues.rays.push_back({(y - startY) * width + x + lane - startX, cameraPos, dirs[lane], hits[lane]});
+                }
+            }
+        }
+    }
+
+    for (int bounce = 0; !queues.rays.empty(); bounce++) {
+        shadeWave(bounce, reflectRecursion - bounce);
+        traceBounces();
+    }
+
+    // fold each path from its far end, as the recursion unwinds
+    RowColors &row = threadRowColors(width);
+    for (int p = 0; p < pixels; p++) {
+        Vec3 color = BACKGROUND_COLOR;
+        for (int k = queues.pathLength[p] - 1; k >= 0; k--) {
+            const PathVertex &v = queues.path[(size_t)p * maxVertices + k];
+            color = v.reflectiveness < 0 ? v.local : v.local * (1 - v.reflectiveness) + color * v.reflectiveness;
+        }
+        int x = p % width;
+        row.r[x] = color.x, row.g[x] = color.y, row.b[x] = color.z;
+        if (x == width - 1) {
+            storeRow(surface, startX, startY + p / width, width, row, accum);
+        }
+    }
+}
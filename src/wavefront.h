@@ -0,0 +1,11 @@
+#pragma once
+
+#include "renderer.h"
+
+// Breadth-first alternative to the recursive tracer, selected by useWavefront.
+// A tile's camera rays are intersected first; then each bounce runs as bulk
+// stages over compacted queues: shadow rays grouped by light, shading, and
+// reflection rays sorted by direction before they are intersected. Colours
+// are folded back along each pixel's path in the recursive tracer's order,
+// so the two executors produce bit-identical images.
+void traceTileWavefront(SDL_Surface *surface, int startX, int startY, int endX, int endY, Accumulation *accum);